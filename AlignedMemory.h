@@ -0,0 +1,54 @@
+//
+//  AlignedMemory.h
+//
+//  malloc and free for memory aligned to a cache line or a
+//    vector register.
+//
+
+#ifndef __ALIGNEDMEMORY_H__
+#define __ALIGNEDMEMORY_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#define CACHE_LINE_SIZE 64
+
+inline void* Aligned_Malloc(size_t bytes, size_t alignment = CACHE_LINE_SIZE){
+	if(bytes == 0)
+		bytes = alignment;
+#ifdef _WIN32
+	return _aligned_malloc(bytes, alignment);
+#else
+	void *p = NULL;
+	if(posix_memalign(&p, alignment, bytes) != 0)
+		return NULL;
+	return p;
+#endif
+}
+
+inline void Aligned_Free(void *p){
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+// move array to a new aligned block of capacity elements, the first count are kept,
+// only for plain data, nothing is constructed
+template<class T>
+inline void Aligned_Grow(T *&array, size_t count, size_t capacity){
+	static_assert(std::is_trivially_copyable<T>::value, "Aligned_Grow copies with memcpy");
+	T *p = (T *)Aligned_Malloc(sizeof(T) * capacity);
+	if(array != NULL){
+		memcpy(p, array, sizeof(T) * count);
+		Aligned_Free(array);
+	}
+	array = p;
+}
+
+#endif
@@ -0,0 +1,652 @@
+//
+//  Batch.cpp
+//
+//  Runs the simulation without a window, for machines with no
+//    display.  This is a separate console program, build it
+//    with the solver files but without Main.cpp.  It runs a
+//    fixed number of steps as fast as possible, prints the
+//    step rate, and can write every n-th frame to text files.
+//
+//  Batch [options]
+//    --scene block|dam|drop   initial particles (default block)
+//    --steps n                steps to run (default 1000)
+//    --time t                 run until t seconds of physical time instead
+//    --kernel h               kernel size, also the cell size
+//    --spacing s              particle spacing as a fraction of h (default 0.6)
+//    --world w h              world size
+//    --mass m  --stiffness k  --rest-density p0  --viscosity mu
+//    --gravity gx gy  --dt t  --wall-hit f
+//    --walls field|clamp      walls from a baked distance field (default) or only clamping
+//    --wall-subdivide s       distance field nodes per cell edge (default 4)
+//    --obstacle file x y s    the faces of an OBJ file projected onto x y, scaled by s and
+//                             moved by (x, y), as a solid in the world, also on --restart
+//    --adaptive min max       choose the time step between min and max every step
+//    --cfl c                  CFL number of the adaptive time step (default 0.4)
+//    --solver wcsph|iisph|pcisph  pressure solver (default wcsph)
+//    --tolerance e            allowed mean compression of the iterative solvers (default 0.01)
+//    --iterations min max     iteration bounds of the iterative solvers
+//    --threads n              0 for the OpenMP default
+//    --simd scalar|sse4|avx2|avx512
+//    --order row|morton|hilbert  --reorder n
+//    --neighbor-list skin     reuse neighbor lists, skin as a fraction of h
+//    --symmetric              evaluate every pair once in the force pass
+//    --dump prefix            write frames to prefix_00000.txt, ...
+//    --dump-every n           steps between frames (default 10)
+//    --profile n              print the time of every phase every n steps
+//    --checkpoint file        save the state to file, at the end and every n steps
+//    --checkpoint-every n     steps between checkpoints (default 1000)
+//    --restart file           continue from a checkpoint instead of a scene, its
+//                             parameters replace the ones given here, --steps and
+//                             --time count from the start of the first run
+//    --frames file            stream binary frames to file on a writer thread
+//    --frame-fields list      pos,vel,acc,dens,pres,id or all (default pos,vel)
+//    --frame-every n          steps between frames (default 1)
+//    --frame-queue n          frames the writer may be behind (default 8)
+//    --frame-drop             drop frames when the writer is behind instead of waiting
+//    --frame-compress k       code the frames with FrameCodec, a key frame every k frames,
+//                             only positions, ids and velocities are kept
+//    --read-frames file       decode a coded frame stream, print what is in it and exit
+//    --preview prefix         draw preview images to prefix_00000.bmp, ... on the CPU
+//    --preview-every n        steps between preview images (default 10)
+//    --preview-size w h       image size in pixels (default 512 512)
+//    --preview-color density|velocity
+//    --surface prefix         write the free surface to prefix_00000.obj, ... as lines
+//    --surface-every n        steps between surfaces (default 10)
+//    --surface-subdivide s    grid squares per cell edge (default 1)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <algorithm>
+#include "SPH.h"
+#include "FrameWriter.h"
+#include "FrameCodec.h"
+#include "SplatRenderer.h"
+#include "Surface.h"
+
+using namespace std;
+
+class Batch_Options
+{
+public:
+	const char *scene;
+	int steps;
+	double time;					// physical seconds to run, 0 to run steps
+	Real kernel;
+	Real spacing;
+	Real world_x;
+	Real world_y;
+	Real mass;
+	Real stiffness;
+	Real rest_density;
+	Real viscosity;
+	bool gravity;					// gravity_x and gravity_y were given
+	Real gravity_x;
+	Real gravity_y;
+	Real dt;
+	Real wall_hit;
+	const char *walls;
+	int wall_subdivide;
+	const char *obstacle;
+	Real obstacle_x, obstacle_y, obstacle_scale;
+	Real min_dt;					// 0 for a fixed time step
+	Real max_dt;
+	Real cfl;
+	const char *solver;
+	Real tolerance;
+	int min_iterations;				// negative to keep the defaults
+	int max_iterations;
+	int threads;
+	const char *simd;
+	const char *order;
+	int reorder;
+	Real skin;						// 0 without neighbor lists
+	bool symmetric;
+	const char *dump;				// NULL for no frames
+	int dump_every;
+	int profile;					// 0 to only print the phase times at the end
+	const char *checkpoint;			// NULL for no checkpoints
+	int checkpoint_every;
+	const char *restart;			// NULL to start from the scene
+	const char *frames;				// NULL for no frame stream
+	const char *frame_fields;
+	int frame_every;
+	int frame_queue;
+	bool frame_drop;
+	int frame_compress;				// key frame interval, 0 for raw frames
+	const char *read_frames;		// NULL to run the simulation
+	const char *preview;			// NULL for no preview images
+	int preview_every;
+	int preview_width, preview_height;
+	const char *preview_color;
+	const char *surface;			// NULL for no surfaces
+	int surface_every;
+	int surface_subdivide;
+
+	// negative values keep the defaults of SPH
+	Batch_Options(){
+		scene = "block";
+		steps = 1000;
+		time = 0.0;
+		kernel = -1.0f;
+		spacing = 0.6f;
+		world_x = world_y = -1.0f;
+		mass = stiffness = rest_density = viscosity = dt = wall_hit = -1.0f;
+		min_dt = max_dt = 0.0f;
+		cfl = -1.0f;
+		gravity = false;
+		gravity_x = gravity_y = 0.0f;
+		solver = NULL;
+		tolerance = -1.0f;
+		min_iterations = max_iterations = -1;
+		threads = 0;
+		simd = NULL;
+		order = NULL;
+		reorder = -1;
+		skin = 0.0f;
+		symmetric = false;
+		walls = "field";
+		wall_subdivide = 4;
+		obstacle = NULL;
+		obstacle_x = obstacle_y = 0.0f;
+		obstacle_scale = 1.0f;
+		dump = NULL;
+		dump_every = 10;
+		profile = 0;
+		checkpoint = NULL;
+		checkpoint_every = 1000;
+		restart = NULL;
+		frames = NULL;
+		frame_fields = "pos,vel";
+		frame_every = 1;
+		frame_queue = 8;
+		frame_drop = false;
+		frame_compress = 0;
+		read_frames = NULL;
+		preview = NULL;
+		preview_every = 10;
+		preview_width = preview_height = 512;
+		preview_color = "density";
+		surface = NULL;
+		surface_every = 10;
+		surface_subdivide = 1;
+	}
+};
+
+static void Print_Usage(){
+	printf("Batch [--scene block|dam|drop] [--steps n] [--time t] [--kernel h] [--spacing s]\n");
+	printf("      [--world w h] [--mass m] [--stiffness k] [--rest-density p0]\n");
+	printf("      [--viscosity mu] [--gravity gx gy] [--dt t] [--wall-hit f]\n");
+	printf("      [--walls field|clamp] [--wall-subdivide s] [--obstacle file x y s]\n");
+	printf("      [--adaptive min max] [--cfl c]\n");
+	printf("      [--solver wcsph|iisph|pcisph] [--tolerance e] [--iterations min max]\n");
+	printf("      [--threads n] [--simd scalar|sse4|avx2|avx512]\n");
+	printf("      [--order row|morton|hilbert] [--reorder n]\n");
+	printf("      [--neighbor-list skin] [--symmetric]\n");
+	printf("      [--dump prefix] [--dump-every n] [--profile n]\n");
+	printf("      [--checkpoint file] [--checkpoint-every n] [--restart file]\n");
+	printf("      [--frames file] [--frame-fields pos,vel,acc,dens,pres,id|all]\n");
+	printf("      [--frame-every n] [--frame-queue n] [--frame-drop] [--frame-compress k]\n");
+	printf("      [--read-frames file] [--preview prefix] [--preview-every n]\n");
+	printf("      [--preview-size w h] [--preview-color density|velocity]\n");
+	printf("      [--surface prefix] [--surface-every n] [--surface-subdivide s]\n");
+}
+
+// false if an option is unknown or misses its value
+static bool Parse_Options(int argc, char** argv, Batch_Options &o){
+	for(int i = 1; i < argc; i++){
+		const char *a = argv[i];
+		int left = argc - i - 1;		// values after the option
+		if((strcmp(a, "--scene") == 0)&&(left >= 1))
+			o.scene = argv[++i];
+		else if((strcmp(a, "--steps") == 0)&&(left >= 1))
+			o.steps = atoi(argv[++i]);
+		else if((strcmp(a, "--time") == 0)&&(left >= 1))
+			o.time = atof(argv[++i]);
+		else if((strcmp(a, "--kernel") == 0)&&(left >= 1))
+			o.kernel = (Real)atof(argv[++i]);
+		else if((strcmp(a, "--spacing") == 0)&&(left >= 1))
+			o.spacing = (Real)atof(argv[++i]);
+		else if((strcmp(a, "--world") == 0)&&(left >= 2)){
+			o.world_x = (Real)atof(argv[++i]);
+			o.world_y = (Real)atof(argv[++i]);
+		}
+		else if((strcmp(a, "--mass") == 0)&&(left >= 1))
+			o.mass = (Real)atof(argv[++i]);
+		else if((strcmp(a, "--stiffness") == 0)&&(left >= 1))
+			o.stiffness = (Real)atof(argv[++i]);
+		else if((strcmp(a, "--rest-density") == 0)&&(left >= 1))
+			o.rest_density = (Real)atof(argv[++i]);
+		else if((strcmp(a, "--viscosity") == 0)&&(left >= 1))
+			o.viscosity = (Real)atof(argv[++i]);
+		else if((strcmp(a, "--gravity") == 0)&&(left >= 2)){
+			o.gravity = true;
+			o.gravity_x = (Real)atof(argv[++i]);
+			o.gravity_y = (Real)atof(argv[++i]);
+		}
+		else if((strcmp(a, "--dt") == 0)&&(left >= 1))
+			o.dt = (Real)atof(argv[++i]);
+		else if((strcmp(a, "--wall-hit") == 0)&&(left >= 1))
+			o.wall_hit = (Real)atof(argv[++i]);
+		else if((strcmp(a, "--walls") == 0)&&(left >= 1))
+			o.walls = argv[++i];
+		else if((strcmp(a, "--wall-subdivide") == 0)&&(left >= 1))
+			o.wall_subdivide = atoi(argv[++i]);
+		else if((strcmp(a, "--obstacle") == 0)&&(left >= 4)){
+			o.obstacle = argv[++i];
+			o.obstacle_x = (Real)atof(argv[++i]);
+			o.obstacle_y = (Real)atof(argv[++i]);
+			o.obstacle_scale = (Real)atof(argv[++i]);
+		}
+		else if((strcmp(a, "--adaptive") == 0)&&(left >= 2)){
+			o.min_dt = (Real)atof(argv[++i]);
+			o.max_dt = (Real)atof(argv[++i]);
+		}
+		else if((strcmp(a, "--cfl") == 0)&&(left >= 1))
+			o.cfl = (Real)atof(argv[++i]);
+		else if((strcmp(a, "--solver") == 0)&&(left >= 1))
+			o.solver = argv[++i];
+		else if((strcmp(a, "--tolerance") == 0)&&(left >= 1))
+			o.tolerance = (Real)atof(argv[++i]);
+		else if((strcmp(a, "--iterations") == 0)&&(left >= 2)){
+			o.min_iterations = atoi(argv[++i]);
+			o.max_iterations = atoi(argv[++i]);
+		}
+		else if((strcmp(a, "--threads") == 0)&&(left >= 1))
+			o.threads = atoi(argv[++i]);
+		else if((strcmp(a, "--simd") == 0)&&(left >= 1))
+			o.simd = argv[++i];
+		else if((strcmp(a, "--order") == 0)&&(left >= 1))
+			o.order = argv[++i];
+		else if((strcmp(a, "--reorder") == 0)&&(left >= 1))
+			o.reorder = atoi(argv[++i]);
+		else if((strcmp(a, "--neighbor-list") == 0)&&(left >= 1))
+			o.skin = (Real)atof(argv[++i]);
+		else if(strcmp(a, "--symmetric") == 0)
+			o.symmetric = true;
+		else if((strcmp(a, "--dump") == 0)&&(left >= 1))
+			o.dump = argv[++i];
+		else if((strcmp(a, "--dump-every") == 0)&&(left >= 1))
+			o.dump_every = atoi(argv[++i]);
+		else if((strcmp(a, "--profile") == 0)&&(left >= 1))
+			o.profile = atoi(argv[++i]);
+		else if((strcmp(a, "--checkpoint") == 0)&&(left >= 1))
+			o.checkpoint = argv[++i];
+		else if((strcmp(a, "--checkpoint-every") == 0)&&(left >= 1))
+			o.checkpoint_every = atoi(argv[++i]);
+		else if((strcmp(a, "--restart") == 0)&&(left >= 1))
+			o.restart = argv[++i];
+		else if((strcmp(a, "--frames") == 0)&&(left >= 1))
+			o.frames = argv[++i];
+		else if((strcmp(a, "--frame-fields") == 0)&&(left >= 1))
+			o.frame_fields = argv[++i];
+		else if((strcmp(a, "--frame-every") == 0)&&(left >= 1))
+			o.frame_every = atoi(argv[++i]);
+		else if((strcmp(a, "--frame-queue") == 0)&&(left >= 1))
+			o.frame_queue = atoi(argv[++i]);
+		else if(strcmp(a, "--frame-drop") == 0)
+			o.frame_drop = true;
+		else if((strcmp(a, "--frame-compress") == 0)&&(left >= 1))
+			o.frame_compress = atoi(argv[++i]);
+		else if((strcmp(a, "--read-frames") == 0)&&(left >= 1))
+			o.read_frames = argv[++i];
+		else if((strcmp(a, "--preview") == 0)&&(left >= 1))
+			o.preview = argv[++i];
+		else if((strcmp(a, "--preview-every") == 0)&&(left >= 1))
+			o.preview_every = atoi(argv[++i]);
+		else if((strcmp(a, "--preview-size") == 0)&&(left >= 2)){
+			o.preview_width = atoi(argv[++i]);
+			o.preview_height = atoi(argv[++i]);
+		}
+		else if((strcmp(a, "--preview-color") == 0)&&(left >= 1))
+			o.preview_color = argv[++i];
+		else if((strcmp(a, "--surface") == 0)&&(left >= 1))
+			o.surface = argv[++i];
+		else if((strcmp(a, "--surface-every") == 0)&&(left >= 1))
+			o.surface_every = atoi(argv[++i]);
+		else if((strcmp(a, "--surface-subdivide") == 0)&&(left >= 1))
+			o.surface_subdivide = atoi(argv[++i]);
+		else{
+			printf("Unknown or incomplete option %s\n", a);
+			return false;
+		}
+	}
+	if((o.steps < 0)||(o.dump_every < 1)||(o.checkpoint_every < 1)||(o.frame_every < 1)||(o.frame_queue < 1)||
+	   (o.frame_compress < 0)||(o.preview_every < 1)||
+	   (o.surface_every < 1)||(o.surface_subdivide < 1)||(o.wall_subdivide < 1)){
+		printf("--steps and --frame-compress must be at least 0, --dump-every, --checkpoint-every, --frame-every,\n");
+		printf("--frame-queue, --preview-every, --surface-every, --surface-subdivide and --wall-subdivide at least 1\n");
+		return false;
+	}
+	if((o.min_dt > o.max_dt)||(o.min_dt < 0.0f)){
+		printf("--adaptive needs 0 <= min <= max\n");
+		return false;
+	}
+	return true;
+}
+
+// apply the options to sph, false if a name is unknown
+static bool Configure(SPH &sph, const Batch_Options &o){
+	// the kernel and the world change the grid, so they come first
+	if(o.kernel > 0.0f)
+		sph.Set_Kernel(o.kernel);
+	if((o.world_x > 0.0f)&&(o.world_y > 0.0f))
+		sph.Set_World_Size(Vector2r(o.world_x, o.world_y));
+	if(o.mass > 0.0f)
+		sph.Set_Mass(o.mass);
+	if(o.stiffness > 0.0f)
+		sph.Set_Stiffness(o.stiffness);
+	if(o.rest_density > 0.0f)
+		sph.Set_Rest_Density(o.rest_density);
+	if(o.viscosity >= 0.0f)
+		sph.Set_Viscosity(o.viscosity);
+	if(o.dt > 0.0f)
+		sph.Set_Time_Delta(o.dt);
+	if(o.wall_hit >= 0.0f)
+		sph.Set_Wall_Hit(o.wall_hit);
+	if(o.max_dt > 0.0f)
+		sph.Set_Adaptive_Time_Step(true, o.min_dt, o.max_dt);
+	if(o.cfl > 0.0f)
+		sph.Set_CFL_Number(o.cfl);
+	if(o.tolerance > 0.0f)
+		sph.Set_Solver_Tolerance(o.tolerance);
+	if(o.max_iterations > 0)
+		sph.Set_Solver_Iterations(max(o.min_iterations, 1), o.max_iterations);
+	if(o.gravity)
+		sph.Set_Gravity(Vector2r(o.gravity_x, o.gravity_y));
+	sph.Set_Thread_Number(o.threads);
+	if(o.reorder >= 0)
+		sph.Set_Reorder_Interval(o.reorder);
+	if(o.skin > 0.0f)
+		sph.Set_Neighbor_List(true, o.skin * sph.Get_Kernel());
+	sph.Set_Symmetric_Force(o.symmetric);
+	sph.Set_Profile_Interval(o.profile);
+
+	if(o.simd != NULL){
+		if(strcmp(o.simd, "scalar") == 0) sph.Set_SIMD_Level(SIMD_SCALAR);
+		else if(strcmp(o.simd, "sse4") == 0) sph.Set_SIMD_Level(SIMD_SSE4);
+		else if(strcmp(o.simd, "avx2") == 0) sph.Set_SIMD_Level(SIMD_AVX2);
+		else if(strcmp(o.simd, "avx512") == 0) sph.Set_SIMD_Level(SIMD_AVX512);
+		else{
+			printf("Unknown SIMD level %s\n", o.simd);
+			return false;
+		}
+	}
+	if(o.solver != NULL){
+		if(strcmp(o.solver, "wcsph") == 0) sph.Set_Pressure_Solver(SOLVER_WCSPH);
+		else if(strcmp(o.solver, "iisph") == 0) sph.Set_Pressure_Solver(SOLVER_IISPH);
+		else if(strcmp(o.solver, "pcisph") == 0) sph.Set_Pressure_Solver(SOLVER_PCISPH);
+		else{
+			printf("Unknown pressure solver %s\n", o.solver);
+			return false;
+		}
+	}
+	if(strcmp(o.walls, "field") == 0)
+		sph.Set_Boundary(true, o.wall_subdivide);
+	else if(strcmp(o.walls, "clamp") == 0)
+		sph.Set_Boundary(false, o.wall_subdivide);
+	else{
+		printf("Unknown walls %s\n", o.walls);
+		return false;
+	}
+	if(o.obstacle != NULL){
+		Obstacle obstacle;
+		if(!obstacle.Load_OBJ(o.obstacle, o.obstacle_scale, Vector2r(o.obstacle_x, o.obstacle_y)))
+			return false;
+		sph.Add_Obstacle(obstacle);
+	}
+	if(o.order != NULL){
+		if(strcmp(o.order, "row") == 0) sph.Set_Cell_Order(CURVE_ROW);
+		else if(strcmp(o.order, "morton") == 0) sph.Set_Cell_Order(CURVE_MORTON);
+		else if(strcmp(o.order, "hilbert") == 0) sph.Set_Cell_Order(CURVE_HILBERT);
+		else{
+			printf("Unknown cell order %s\n", o.order);
+			return false;
+		}
+	}
+	return true;
+}
+
+// initial particles, false if the scene is unknown
+static bool Init_Scene(SPH &sph, const char *scene, Real spacing){
+	Vector2r w = sph.Get_World_Size();
+	Real s = sph.Get_Kernel() * spacing;
+	if(strcmp(scene, "block") == 0)			// the block of Init_Fluid falling to the floor
+		sph.Init_Block(Vector2r(w.x * 0.3f, w.y * 0.3f), Vector2r(w.x * 0.7f, w.y * 0.9f), s);
+	else if(strcmp(scene, "dam") == 0)		// a column against the left wall collapsing
+		sph.Init_Block(Vector2r(0.0f, 0.0f), Vector2r(w.x * 0.4f, w.y * 0.8f), s);
+	else if(strcmp(scene, "drop") == 0){	// a drop falling into a pool
+		sph.Init_Block(Vector2r(0.0f, 0.0f), Vector2r(w.x, w.y * 0.3f), s);
+		sph.Init_Block(Vector2r(w.x * 0.4f, w.y * 0.6f), Vector2r(w.x * 0.6f, w.y * 0.8f), s);
+	}
+	else{
+		printf("Unknown scene %s\n", scene);
+		return false;
+	}
+	return true;
+}
+
+// field names separated by commas to Frame_Field bits, 0 if a name is unknown
+static uint32_t Parse_Fields(const char *list){
+	static const char *names[] = {"pos", "vel", "acc", "dens", "pres", "id", "all"};
+	static const uint32_t bits[] = {FIELD_POSITION, FIELD_VELOCITY, FIELD_ACCELERATION, FIELD_DENSITY,
+	                                FIELD_PRESSURE, FIELD_ID, FIELD_ALL};
+	uint32_t fields = 0;
+	const char *p = list;
+	while(*p != 0){
+		size_t length = strcspn(p, ",");
+		int k = 0;
+		while((k < 7)&&!((strlen(names[k]) == length)&&(strncmp(p, names[k], length) == 0)))
+			k++;
+		if(k == 7){
+			printf("Unknown frame field in %s\n", list);
+			return 0;
+		}
+		fields |= bits[k];
+		p += length;
+		if(*p == ',')
+			p++;
+	}
+	return fields;
+}
+
+// decode a coded frame stream and print its frames and the range of the values, false if it is damaged
+static bool Read_Frames(const char *file_name){
+	Frame_Decoder decoder;
+	if(!decoder.Open(file_name))
+		return false;
+	const Codec_File_Header &h = decoder.Get_Header();
+	printf("%s: world %g x %g, key frame every %d frames, %d steps between frames, %s\n", file_name,
+	       h.world_x, h.world_y, h.key_interval, h.stride, (h.fields & FIELD_VELOCITY) ? "with velocities" : "positions only");
+	Decoded_Frame f;
+	int frames = 0, keys = 0;
+	while(decoder.Read(f)){
+		float low_y = f.pos_y.empty() ? 0.0f : *min_element(f.pos_y.begin(), f.pos_y.end());
+		float high_y = f.pos_y.empty() ? 0.0f : *max_element(f.pos_y.begin(), f.pos_y.end());
+		double speed = 0.0;
+		for(size_t i = 0; i < f.vel_x.size(); i++)
+			speed = max(speed, sqrt((double)f.vel_x[i] * f.vel_x[i] + (double)f.vel_y[i] * f.vel_y[i]));
+		printf("step %d, %.4f s, %s, %d particles, y in [%.4f, %.4f], fastest %.4f\n", f.step, f.time,
+		       f.key ? "key" : "delta", (int)f.id.size(), low_y, high_y, speed);
+		frames++;
+		keys += f.key;
+	}
+	printf("frames %d, key frames %d\n", frames, keys);
+	return !decoder.Is_Damaged()&&!ferror(stdout);
+}
+
+// draw sph to prefix_<frame>.bmp, false if it can not be written
+static bool Preview_Frame(SPH &sph, Splat_Renderer &renderer, const char *prefix, int frame, double &render_seconds){
+	char name[1024];
+	snprintf(name, sizeof(name), "%s_%05d.bmp", prefix, frame);
+	renderer.Render(sph);
+	render_seconds += renderer.Get_Render_Seconds();
+	return renderer.Save(name);
+}
+
+// extract the free surface of sph and write it to prefix_<frame>.obj, false if it can not be written
+static bool Surface_Frame(SPH &sph, Surface_Lines &surface, int subdivide, const char *prefix, int frame,
+                          double &surface_seconds){
+	char name[1024];
+	snprintf(name, sizeof(name), "%s_%05d.obj", prefix, frame);
+	sph.Extract_Surface(surface, subdivide);
+	surface_seconds += surface.seconds;
+	return surface.Save_OBJ(name);
+}
+
+// one line per particle: position, velocity, density and pressure
+static bool Dump_Frame(SPH &sph, const char *prefix, int frame){
+	char name[1024];
+	snprintf(name, sizeof(name), "%s_%05d.txt", prefix, frame);
+	FILE *file = fopen(name, "w");
+	if(file == NULL){
+		printf("Can not write %s\n", name);
+		return false;
+	}
+	const Particle_Arrays *p = sph.Get_Particle_Arrays();
+	fprintf(file, "# step %d particles %d\n", sph.Get_Step_Count(), sph.Get_Particle_Number());
+	for(int i = 0; i < sph.Get_Particle_Number(); i++)
+		fprintf(file, "%g %g %g %g %g %g\n", (double)p->pos_x[i], (double)p->pos_y[i],
+		        (double)p->vel_x[i], (double)p->vel_y[i], (double)p->dens[i], (double)p->pres[i]);
+	fclose(file);
+	return true;
+}
+
+int main(int argc, char** argv){
+	Batch_Options o;
+	if(!Parse_Options(argc, argv, o)){
+		Print_Usage();
+		return 1;
+	}
+
+	if(o.read_frames != NULL)
+		return Read_Frames(o.read_frames) ? 0 : 1;
+
+	SPH sph;
+	if(!Configure(sph, o))
+		return 1;
+	if(o.restart != NULL){
+		if(!sph.Load_Checkpoint(o.restart))
+			return 1;
+		printf("restart from %s at step %d, %.4f s\n", o.restart, sph.Get_Step_Count(), sph.Get_Simulation_Time());
+	}
+	else if(!Init_Scene(sph, o.scene, o.spacing))
+		return 1;
+	const char *scene = o.restart != NULL ? o.restart : o.scene;
+	int n = sph.Get_Particle_Number();
+	if(o.time > 0.0)
+		printf("scene %s, %d particles, %g s, %d threads, %s\n", scene, n, o.time,
+		       sph.Get_Thread_Number(), Get_SIMD_Level_Name(sph.Get_SIMD_Level()));
+	else
+		printf("scene %s, %d particles, %d steps, %d threads, %s\n", scene, n, o.steps,
+		       sph.Get_Thread_Number(), Get_SIMD_Level_Name(sph.Get_SIMD_Level()));
+
+	// text frames, preview images and checkpoints are written between steps and not counted in
+	// the step time, after a restart the frame numbers go on from the step of the checkpoint
+	int frame = 0;
+	double elapsed = 0.0;
+	if(o.restart != NULL)
+		frame = sph.Get_Step_Count() / o.dump_every + 1;
+	else if((o.dump != NULL)&&!Dump_Frame(sph, o.dump, frame++))
+		return 1;
+	Splat_Renderer renderer;
+	int preview_frame = 0;
+	double preview_seconds = 0.0;
+	if(o.preview != NULL){
+		if(!renderer.Set_Size(o.preview_width, o.preview_height))
+			return 1;
+		if(strcmp(o.preview_color, "density") == 0)
+			renderer.Set_Color(SPLAT_DENSITY, 0.0f, 0.0f);
+		else if(strcmp(o.preview_color, "velocity") == 0)
+			renderer.Set_Color(SPLAT_VELOCITY, 0.0f, 0.0f);
+		else{
+			printf("Unknown preview color %s\n", o.preview_color);
+			return 1;
+		}
+		renderer.Set_Threads(sph.Get_Thread_Number());
+		if(o.restart != NULL)
+			preview_frame = sph.Get_Step_Count() / o.preview_every + 1;
+		else if(!Preview_Frame(sph, renderer, o.preview, preview_frame++, preview_seconds))
+			return 1;
+	}
+	Surface_Lines surface;
+	int surface_frame = 0;
+	double surface_seconds = 0.0;
+	if(o.surface != NULL){
+		if(o.restart != NULL)
+			surface_frame = sph.Get_Step_Count() / o.surface_every + 1;
+		else if(!Surface_Frame(sph, surface, o.surface_subdivide, o.surface, surface_frame++, surface_seconds))
+			return 1;
+	}
+	Frame_Writer writer;
+	uint32_t fields = o.frames != NULL ? Parse_Fields(o.frame_fields) : 0;
+	Frame_Encoder encoder(sph.Get_World_Size(), fields, o.frame_compress);
+	if(o.frames != NULL){
+		if((fields == 0)||!writer.Open(o.frames, fields, o.frame_every, o.frame_queue, o.frame_drop,
+		                               o.frame_compress > 0 ? &encoder : NULL))
+			return 1;
+		writer.Submit(sph);
+	}
+	int steps = 0;
+	double start_time = sph.Get_Simulation_Time();
+	while((o.time > 0.0) ? (sph.Get_Simulation_Time() < o.time) : (sph.Get_Step_Count() < o.steps)){
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		sph.Animation();
+		if(writer.Is_Open())
+			writer.Submit(sph);				// the copy and any wait for the writer count as step time
+		elapsed += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		steps++;
+		int step = sph.Get_Step_Count();
+		if((o.dump != NULL)&&(step % o.dump_every == 0)&&!Dump_Frame(sph, o.dump, frame++))
+			return 1;
+		if((o.preview != NULL)&&(step % o.preview_every == 0)&&
+		   !Preview_Frame(sph, renderer, o.preview, preview_frame++, preview_seconds))
+			return 1;
+		if((o.surface != NULL)&&(step % o.surface_every == 0)&&
+		   !Surface_Frame(sph, surface, o.surface_subdivide, o.surface, surface_frame++, surface_seconds))
+			return 1;
+		if((o.checkpoint != NULL)&&(step % o.checkpoint_every == 0)&&!sph.Save_Checkpoint(o.checkpoint))
+			return 1;
+	}
+	if((o.checkpoint != NULL)&&!sph.Save_Checkpoint(o.checkpoint))
+		return 1;
+	if(writer.Is_Open()&&!writer.Close())
+		return 1;
+
+	double steps_per_second = elapsed > 0.0 ? steps / elapsed : 0.0;
+	printf("time %.3f s\n", elapsed);
+	// the totals of sph include the steps before a restart
+	int total_steps = sph.Get_Step_Count();
+	printf("steps %d, simulated %.4f s, mean dt %.3g s\n", steps, sph.Get_Simulation_Time(),
+	       total_steps > 0 ? sph.Get_Simulation_Time() / total_steps : 0.0);
+	printf("steps/s %.2f\n", steps_per_second);
+	if(sph.Get_Pressure_Solver() != SOLVER_WCSPH)
+		printf("solver iterations per step %.2f, last density error %.3f%%\n",
+		       total_steps > 0 ? (double)sph.Get_Total_Solver_Iterations() / total_steps : 0.0,
+		       sph.Get_Density_Error() * 100.0);
+	printf("simulated s per s %.4f\n", elapsed > 0.0 ? (sph.Get_Simulation_Time() - start_time) / elapsed : 0.0);
+	printf("particle-updates/s %.4g\n", steps_per_second * n);
+	if(o.dump != NULL)
+		printf("frames %d\n", frame);
+	if(sph.Get_Boundary())
+		printf("wall field %d nodes, %d obstacles, baked in %.1f ms\n", sph.Get_Boundary_Field().Get_Node_Number(),
+		       sph.Get_Obstacle_Number(), sph.Get_Boundary_Field().Get_Bake_Seconds() * 1000.0);
+	if(o.preview != NULL)
+		printf("preview images %d, %.3f ms to draw one, %d of %d particles in the last\n", preview_frame,
+		       preview_frame > 0 ? preview_seconds * 1000.0 / preview_frame : 0.0, renderer.Get_Drawn(), n);
+	if(o.surface != NULL)
+		printf("surfaces %d, %.3f ms to extract one, %.1f%% of a step, %d segments in the last\n", surface_frame,
+		       surface_frame > 0 ? surface_seconds * 1000.0 / surface_frame : 0.0,
+		       (surface_frame > 0)&&(steps_per_second > 0.0) ? surface_seconds / surface_frame * steps_per_second * 100.0 : 0.0,
+		       surface.Get_Segment_Number());
+	if(o.frames != NULL)
+		writer.Get_Stats().Print(stdout);
+	if((o.frames != NULL)&&(o.frame_compress > 0))
+		encoder.Get_Report().Print(stdout);
+	if(o.profile == 0)
+		sph.Get_Profiler().Print(stdout);
+	return 0;
+}
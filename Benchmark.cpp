@@ -0,0 +1,417 @@
+//
+//  Benchmark.cpp
+//
+//  Benchmarks for the SPH solver.  This is a separate console
+//    program, build it with the solver files but without
+//    Main.cpp.  Every benchmark is a function that repeats the
+//    measured work while Keep_Running() is true.  The runner
+//    raises the number of repetitions until a run lasts at
+//    least the minimum time, like Google Benchmark does, and
+//    prints a table and optionally a JSON file for tracking
+//    results between versions.
+//
+//  Benchmark [--filter text] [--min-time seconds] [--threads n]
+//            [--json file] [--list]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include "Kernel.h"
+#include "SPH.h"
+#include "SplatRenderer.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+static double Now(){
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static volatile double Sink;		// results go here so the compiler keeps the work
+static int Thread_Number = 0;		// threads of the solver, 0 for the OpenMP default
+
+//
+//  Framework
+//
+
+// passed to a benchmark, counts the repetitions and times them
+class Benchmark_State
+{
+public:
+	int arg;						// size or thread count of the case
+	long long max_iterations;
+	long long iterations;
+	double start;
+	double elapsed;					// seconds of all repetitions
+	double items;					// work items per repetition, particles or kernel calls
+	int particles;					// particles of the scene, 0 if there is none
+
+	Benchmark_State(int a, long long n){
+		arg = a;
+		max_iterations = n;
+		iterations = 0;
+		start = elapsed = 0.0;
+		items = 0.0;
+		particles = 0;
+	}
+
+	// the timing starts with the first call, everything before it is setup
+	bool Keep_Running(){
+		if(iterations == 0)
+			start = Now();
+		if(iterations < max_iterations){
+			iterations++;
+			return true;
+		}
+		elapsed = Now() - start;
+		return false;
+	}
+};
+
+typedef void (*Benchmark_Function)(Benchmark_State &state);
+
+class Benchmark_Case
+{
+public:
+	string name;
+	Benchmark_Function function;
+	int arg;
+};
+
+class Benchmark_Result
+{
+public:
+	string name;
+	long long iterations;
+	double seconds_per_iteration;
+	double items_per_second;
+	int particles;
+};
+
+static vector<Benchmark_Case> Registry;
+
+// one case per argument, named name/arg, or just name if there are no arguments
+static void Register(const char *name, Benchmark_Function function, const vector<int> &args = vector<int>()){
+	Benchmark_Case c;
+	c.function = function;
+	if(args.empty()){
+		c.name = name;
+		c.arg = 0;
+		Registry.push_back(c);
+	}
+	for(size_t i = 0; i < args.size(); i++){
+		c.name = string(name) + "/" + to_string(args[i]);
+		c.arg = args[i];
+		Registry.push_back(c);
+	}
+}
+
+// repeat with more iterations until a run lasts at least min_time
+static Benchmark_Result Run_Case(const Benchmark_Case &c, double min_time){
+	long long n = 1;
+	for(;;){
+		Benchmark_State state(c.arg, n);
+		c.function(state);
+		if((state.elapsed >= min_time)||(n >= 1000000000LL)){
+			Benchmark_Result r;
+			r.name = c.name;
+			r.iterations = n;
+			r.seconds_per_iteration = state.elapsed / n;
+			r.items_per_second = state.elapsed > 0.0 ? state.items * n / state.elapsed : 0.0;
+			r.particles = state.particles;
+			return r;
+		}
+		// aim a bit above min_time, but grow at most 100 times per round
+		double per = state.elapsed / n;
+		long long next = per > 0.0 ? (long long)(min_time * 1.4 / per) : n * 100;
+		n = max(n + 1, min(next, n * 100));
+	}
+}
+
+//
+//  Scenes
+//
+
+// the dam break block of Init_Fluid with about n particles, the world grows with n
+// so the spacing and the neighbors per particle stay the same
+static void Init_Dam(SPH &sph, int n){
+	sph.Set_Thread_Number(Thread_Number);
+	Real h = sph.Get_Kernel();
+	// Init_Fluid fills 0.4 x 0.6 of the world at a spacing of 0.6 h
+	Real w = h * (Real)sqrt(1.5 * n);
+	sph.Set_World_Size(Vector2r(w, w));
+	sph.Reserve(n + n / 8);
+	sph.Init_Fluid();
+}
+
+// steps until the grid is sorted and every density is set
+static void Settle(SPH &sph){
+	for(int i = 0; i < 2; i++)
+		sph.Animation();
+}
+
+//
+//  Kernels
+//
+
+#define KERNEL_INPUTS 4096
+
+// the kernel and equation of state as they were written with pow
+static Real Poly6_Pow(const Kernel_Constants &c, Real r2){
+	return c.poly6 * pow(c.kernel2 - r2, 3);
+}
+
+static Real Tait_Pressure_Pow(Real dens, Real rest_density, Real k){
+	return (pow(dens / rest_density, 7) - 1) * k;
+}
+
+static Kernel_Constants Default_Constants(){
+	Kernel_Constants c;
+	c.Set(0.04f, 0.02f, 8.0f);
+	return c;
+}
+
+// KERNEL_INPUTS values spread over [low, high)
+static vector<Real> Inputs(Real low, Real high){
+	vector<Real> v(KERNEL_INPUTS);
+	srand(1);
+	for(int i = 0; i < KERNEL_INPUTS; i++)
+		v[i] = low + (high - low) * rand() / ((Real)RAND_MAX + 1);
+	return v;
+}
+
+// time f over the inputs
+template<class F>
+static void Run_Kernel(Benchmark_State &state, const vector<Real> &input, F f){
+	Real sum = 0.0f;
+	while(state.Keep_Running())
+		for(int i = 0; i < KERNEL_INPUTS; i++)
+			sum += f(input[i]);
+	Sink = sum;
+	state.items = KERNEL_INPUTS;
+}
+
+static void BM_Poly6(Benchmark_State &state){
+	Kernel_Constants c = Default_Constants();
+	Run_Kernel(state, Inputs(0.0f, c.kernel2), [&](Real r2){ return Kernel_Poly6(c, r2); });
+}
+
+static void BM_Poly6_Pow(Benchmark_State &state){
+	Kernel_Constants c = Default_Constants();
+	Run_Kernel(state, Inputs(0.0f, c.kernel2), [&](Real r2){ return Poly6_Pow(c, r2); });
+}
+
+static void BM_Spiky(Benchmark_State &state){
+	Kernel_Constants c = Default_Constants();
+	Run_Kernel(state, Inputs(0.0f, c.kernel), [&](Real r){ return Kernel_Spiky(c, r); });
+}
+
+static void BM_Visco(Benchmark_State &state){
+	Kernel_Constants c = Default_Constants();
+	Run_Kernel(state, Inputs(0.0f, c.kernel), [&](Real r){ return Kernel_Visco(c, r); });
+}
+
+static void BM_Tait(Benchmark_State &state){
+	Run_Kernel(state, Inputs(900.0f, 1100.0f), [](Real d){ return Tait_Pressure(d, 1000.0f, 1000.0f); });
+}
+
+static void BM_Tait_Pow(Benchmark_State &state){
+	Run_Kernel(state, Inputs(900.0f, 1100.0f), [](Real d){ return Tait_Pressure_Pow(d, 1000.0f, 1000.0f); });
+}
+
+//
+//  Solver phases, arg is the number of particles
+//
+
+static void BM_Hash_Grid(Benchmark_State &state){
+	SPH sph;
+	Init_Dam(sph, state.arg);
+	Settle(sph);
+	while(state.Keep_Running())
+		sph.Hash_Grid();
+	state.particles = state.items = sph.Get_Particle_Number();
+}
+
+static void BM_Density(Benchmark_State &state){
+	SPH sph;
+	Init_Dam(sph, state.arg);
+	Settle(sph);
+	while(state.Keep_Running())
+		sph.Comupte_Density_SingPressure();
+	state.particles = state.items = sph.Get_Particle_Number();
+}
+
+static void BM_Force(Benchmark_State &state){
+	SPH sph;
+	Init_Dam(sph, state.arg);
+	Settle(sph);
+	while(state.Keep_Running())
+		sph.Computer_Force();
+	state.particles = state.items = sph.Get_Particle_Number();
+}
+
+static void BM_Animation(Benchmark_State &state){
+	SPH sph;
+	Init_Dam(sph, state.arg);
+	Settle(sph);
+	while(state.Keep_Running())
+		sph.Animation();
+	state.particles = state.items = sph.Get_Particle_Number();
+}
+
+// a full step of the Init_Fluid scene, arg is the number of threads
+static void BM_Animation_Threads(Benchmark_State &state){
+	SPH sph;
+	sph.Set_Thread_Number(state.arg);
+	sph.Init_Fluid();
+	Settle(sph);
+	while(state.Keep_Running())
+		sph.Animation();
+	state.particles = state.items = sph.Get_Particle_Number();
+}
+
+// a 512 x 512 preview image of the dam, arg is the number of particles
+static void BM_Splat(Benchmark_State &state){
+	SPH sph;
+	Init_Dam(sph, state.arg);
+	Settle(sph);
+	Splat_Renderer renderer;
+	renderer.Set_Threads(Thread_Number);
+	while(state.Keep_Running())
+		renderer.Render(sph);
+	state.particles = state.items = sph.Get_Particle_Number();
+}
+
+static void Register_Benchmarks(){
+	vector<int> sizes = {1000, 10000, 100000, 1000000};
+	vector<int> threads;
+	int max_threads = 1;
+#ifdef _OPENMP
+	max_threads = omp_get_max_threads();
+#endif
+	for(int t = 1; t < max_threads; t *= 2)
+		threads.push_back(t);
+	threads.push_back(max_threads);
+
+	Register("Poly6", BM_Poly6);
+	Register("Poly6_Pow", BM_Poly6_Pow);
+	Register("Spiky", BM_Spiky);
+	Register("Visco", BM_Visco);
+	Register("Tait_Pressure", BM_Tait);
+	Register("Tait_Pressure_Pow", BM_Tait_Pow);
+	Register("Hash_Grid", BM_Hash_Grid, sizes);
+	Register("Density", BM_Density, sizes);
+	Register("Force", BM_Force, sizes);
+	Register("Animation", BM_Animation, sizes);
+	Register("Animation_Threads", BM_Animation_Threads, threads);
+	Register("Splat", BM_Splat, sizes);
+}
+
+//
+//  Output
+//
+
+static void Write_JSON(FILE *file, const vector<Benchmark_Result> &results){
+	char date[64];
+	time_t now = time(NULL);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+	SPH sph;
+	sph.Set_Thread_Number(Thread_Number);
+
+	fprintf(file, "{\n");
+	fprintf(file, "  \"context\": {\n");
+	fprintf(file, "    \"date\": \"%s\",\n", date);
+	fprintf(file, "    \"threads\": %d,\n", sph.Get_Thread_Number());
+	fprintf(file, "    \"simd\": \"%s\",\n", Get_SIMD_Level_Name(sph.Get_SIMD_Level()));
+	fprintf(file, "    \"precision\": \"%s\"\n", sizeof(Real) == sizeof(float) ? "float" : "double");
+	fprintf(file, "  },\n");
+	fprintf(file, "  \"benchmarks\": [\n");
+	for(size_t i = 0; i < results.size(); i++){
+		const Benchmark_Result &r = results[i];
+		fprintf(file, "    {\"name\": \"%s\", \"iterations\": %lld, \"real_time_ns\": %.3f, "
+		        "\"items_per_second\": %.6g, \"particles\": %d}%s\n",
+		        r.name.c_str(), r.iterations, r.seconds_per_iteration * 1e9, r.items_per_second,
+		        r.particles, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n");
+	fprintf(file, "}\n");
+}
+
+static void Print_Usage(){
+	printf("Benchmark [--filter text] [--min-time seconds] [--threads n] [--json file] [--list]\n");
+}
+
+int main(int argc, char** argv){
+	const char *filter = "";
+	const char *json = NULL;
+	double min_time = 0.5;
+	bool list = false;
+	for(int i = 1; i < argc; i++){
+		int left = argc - i - 1;
+		if((strcmp(argv[i], "--filter") == 0)&&(left >= 1))
+			filter = argv[++i];
+		else if((strcmp(argv[i], "--min-time") == 0)&&(left >= 1))
+			min_time = atof(argv[++i]);
+		else if((strcmp(argv[i], "--threads") == 0)&&(left >= 1))
+			Thread_Number = atoi(argv[++i]);
+		else if((strcmp(argv[i], "--json") == 0)&&(left >= 1))
+			json = argv[++i];
+		else if(strcmp(argv[i], "--list") == 0)
+			list = true;
+		else{
+			Print_Usage();
+			return 1;
+		}
+	}
+
+	Register_Benchmarks();
+	// the solver reports on cout, keep it out of the table
+	streambuf *console = cout.rdbuf(NULL);
+
+	vector<Benchmark_Result> results;
+	if(!list)
+		printf("%-28s %14s %12s %14s %10s\n", "benchmark", "time/iter", "iterations", "items/s", "particles");
+	for(size_t i = 0; i < Registry.size(); i++){
+		const Benchmark_Case &c = Registry[i];
+		if(c.name.find(filter) == string::npos)
+			continue;
+		if(list){
+			printf("%s\n", c.name.c_str());
+			continue;
+		}
+		Benchmark_Result r = Run_Case(c, min_time);
+		double t = r.seconds_per_iteration;
+		const char *unit = "ns";
+		double scale = 1e9;
+		if(t >= 1e-3){ unit = "ms"; scale = 1e3; }
+		else if(t >= 1e-6){ unit = "us"; scale = 1e6; }
+		printf("%-28s %11.3f %s %12lld %14.4g %10d\n", r.name.c_str(), t * scale, unit,
+		       r.iterations, r.items_per_second, r.particles);
+		fflush(stdout);
+		results.push_back(r);
+	}
+
+	if(json != NULL){
+		FILE *file = fopen(json, "w");
+		if(file == NULL){
+			printf("Can not write %s\n", json);
+			cout.rdbuf(console);
+			return 1;
+		}
+		Write_JSON(file, results);
+		fclose(file);
+		printf("results written to %s\n", json);
+	}
+	cout.rdbuf(console);
+	return 0;
+}
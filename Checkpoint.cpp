@@ -0,0 +1,475 @@
+//
+//  Checkpoint.cpp
+//
+//  Saving and restoring the whole state of a simulation, so a
+//    run can go on after the program stopped.  A checkpoint is
+//    a header with the parameters followed by the particle
+//    arrays, every array starting on a cache line.  The header
+//    and the arrays have their own checksums, and the version,
+//    byte order and size of Real are checked before anything
+//    is read.
+//
+//  The file is built in memory and written with one fwrite to
+//    a temporary name that then replaces the old checkpoint,
+//    so a run stopped while writing keeps the last one.  It is
+//    loaded by mapping the file into memory and copying the
+//    arrays, with no reads of small pieces.
+//
+//  The thread number, the SIMD level and the profile interval
+//    belong to the machine and are not saved.  The obstacles
+//    are part of the setup like a scene file, a restarted run
+//    adds them again.  The grid, the wall field and the solver
+//    scratch arrays are rebuilt by the next step.
+//    A valid neighbor list is saved, rebuilding it would also
+//    reorder the particles at another step, so with it a
+//    restarted run takes exactly the steps of an uninterrupted
+//    one.
+//
+
+#include "SPH.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <algorithm>
+
+using namespace std;
+
+#define CHECKPOINT_MAGIC "SPHCKPT"
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_BYTE_ORDER 0x01020304u		// reads differently on a machine of the other byte order
+#define CHECKPOINT_ARRAYS 13		// the arrays of Checkpoint_Array
+
+// the arrays after the header, in this order
+enum Checkpoint_Array{
+	ARRAY_POS_X, ARRAY_POS_Y, ARRAY_VEL_X, ARRAY_VEL_Y, ARRAY_ACC_X, ARRAY_ACC_Y, ARRAY_DENS, ARRAY_PRES,
+	ARRAY_ID,
+	ARRAY_LIST_POS_X, ARRAY_LIST_POS_Y,		// the neighbor list, empty when it is not valid
+	ARRAY_NEIGHBOR_START, ARRAY_NEIGHBOR_INDEX
+};
+
+// the beginning of a checkpoint, only fixed size types and no padding
+struct Checkpoint_Header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t byte_order;
+	uint32_t real_size;			// sizeof(Real) of the particle arrays
+
+	// parameters
+	double kernel;
+	double mass;
+	double world_x;
+	double world_y;
+	double gravity_x;
+	double gravity_y;
+	double stiffness;
+	double rest_density;
+	double time_delta;
+	double min_time_delta;
+	double max_time_delta;
+	double cfl_number;
+	double simulation_time;
+	double solver_tolerance;
+	double wall_hit;
+	double viscosity;
+	double skin;
+	int64_t total_solver_iterations;
+	int32_t adaptive_time;
+	int32_t solver;
+	int32_t min_solver_iterations;
+	int32_t max_solver_iterations;
+	int32_t cell_order;
+	int32_t reorder_interval;
+	int32_t next_reorder;
+	int32_t step_count;
+	int32_t use_neighbor_list;
+	int32_t use_symmetric_force;
+	int32_t use_boundary;
+	int32_t boundary_subdivide;
+
+	// particle arrays and the neighbor list, which is saved so a restart gives the same steps
+	int32_t particles;
+	int32_t neighbor_list_valid;
+	int32_t neighbor_builds;
+	int32_t neighbor_steps;
+	int64_t neighbor_count;
+	uint64_t array_offset[CHECKPOINT_ARRAYS];	// from the start of the file
+	uint64_t file_size;
+	uint64_t data_checksum;						// of everything after the header
+	uint64_t header_checksum;					// of the header up to here, the last field
+};
+
+static_assert(offsetof(Checkpoint_Header, header_checksum) + 8 == sizeof(Checkpoint_Header),
+              "the checkpoint header must not have padding");
+
+// Fletcher checksum of 32 bit words, the sums are reduced once per block so it reads about as
+// fast as memory, a size that is not a multiple of 4 is padded with zeros
+static uint64_t Checksum(const void *data, size_t bytes){
+	const unsigned char *p = (const unsigned char *)data;
+	const size_t block = 65536;			// words before the sums could overflow 64 bits
+	uint64_t a = 0, b = 0;
+	size_t words = (bytes + 3) / 4;
+	for(size_t start = 0; start < words; start += block){
+		size_t end = min(start + block, bytes / 4);
+		for(size_t i = start; i < end; i++){
+			uint32_t w;
+			memcpy(&w, p + i * 4, 4);
+			a += w;
+			b += a;
+		}
+		if(end < min(start + block, words)){		// the last bytes
+			uint32_t w = 0;
+			memcpy(&w, p + end * 4, bytes % 4);
+			a += w;
+			b += a;
+		}
+		a %= 0xFFFFFFFFull;
+		b %= 0xFFFFFFFFull;
+	}
+	return (b << 32) | a;
+}
+
+static uint64_t Header_Checksum(const Checkpoint_Header &h){
+	return Checksum(&h, offsetof(Checkpoint_Header, header_checksum));
+}
+
+// bytes of every array of a checkpoint
+static void Array_Sizes(const Checkpoint_Header &h, uint64_t sizes[CHECKPOINT_ARRAYS]){
+	uint64_t n = (uint64_t)h.particles;
+	uint64_t list = h.neighbor_list_valid ? n : 0;
+	for(int a = ARRAY_POS_X; a <= ARRAY_PRES; a++)
+		sizes[a] = n * h.real_size;
+	sizes[ARRAY_ID] = n * sizeof(int32_t);
+	sizes[ARRAY_LIST_POS_X] = sizes[ARRAY_LIST_POS_Y] = list * h.real_size;
+	sizes[ARRAY_NEIGHBOR_START] = h.neighbor_list_valid ? (n + 1) * sizeof(int32_t) : 0;
+	sizes[ARRAY_NEIGHBOR_INDEX] = h.neighbor_list_valid ? (uint64_t)h.neighbor_count * sizeof(int32_t) : 0;
+}
+
+static uint64_t Align_Offset(uint64_t offset){
+	return (offset + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+// a whole file mapped into memory for reading
+class Mapped_File
+{
+public:
+	const unsigned char *data;
+	uint64_t size;
+
+	Mapped_File(){
+		data = NULL;
+		size = 0;
+#ifdef _WIN32
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+#endif
+	}
+
+	~Mapped_File(){
+		Close();
+	}
+
+	bool Open(const char *file_name){
+#ifdef _WIN32
+		file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		                   FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if(file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER bytes;
+		if(!GetFileSizeEx(file, &bytes)||(bytes.QuadPart == 0))
+			return false;
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if(mapping == NULL)
+			return false;
+		data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		size = (uint64_t)bytes.QuadPart;
+		return data != NULL;
+#else
+		int fd = open(file_name, O_RDONLY);
+		if(fd < 0)
+			return false;
+		struct stat st;
+		if((fstat(fd, &st) != 0)||(st.st_size == 0)){
+			close(fd);
+			return false;
+		}
+		void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);			// the mapping stays valid without the descriptor
+		if(p == MAP_FAILED)
+			return false;
+		madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+		data = (const unsigned char *)p;
+		size = (uint64_t)st.st_size;
+		return true;
+#endif
+	}
+
+	void Close(){
+#ifdef _WIN32
+		if(data != NULL)
+			UnmapViewOfFile(data);
+		if(mapping != NULL)
+			CloseHandle(mapping);
+		if(file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+#else
+		if(data != NULL)
+			munmap((void *)data, (size_t)size);
+#endif
+		data = NULL;
+		size = 0;
+	}
+
+private:
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+	Mapped_File(const Mapped_File&);
+	Mapped_File& operator=(const Mapped_File&);
+};
+
+// move the file from over the file to, in one step where the system allows it
+static bool Replace_File(const char *from, const char *to){
+#ifdef _WIN32
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+bool SPH::Save_Checkpoint(const char *file_name){
+	Checkpoint_Header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	h.version = CHECKPOINT_VERSION;
+	h.header_size = sizeof(Checkpoint_Header);
+	h.byte_order = CHECKPOINT_BYTE_ORDER;
+	h.real_size = sizeof(Real);
+
+	h.kernel = kernel;
+	h.mass = mass;
+	h.world_x = World_Size.x;
+	h.world_y = World_Size.y;
+	h.gravity_x = Gravity.x;
+	h.gravity_y = Gravity.y;
+	h.stiffness = K;
+	h.rest_density = Stand_Density;
+	h.time_delta = Time_Delta;
+	h.min_time_delta = Min_Time_Delta;
+	h.max_time_delta = Max_Time_Delta;
+	h.cfl_number = CFL_Number;
+	h.simulation_time = Simulation_Time;
+	h.solver_tolerance = Solver_Tolerance;
+	h.wall_hit = Wall_Hit;
+	h.viscosity = Viscosity_Constant;
+	h.skin = Skin;
+	h.total_solver_iterations = Total_Solver_Iterations;
+	h.adaptive_time = Adaptive_Time;
+	h.solver = Solver;
+	h.min_solver_iterations = Min_Solver_Iterations;
+	h.max_solver_iterations = Max_Solver_Iterations;
+	h.cell_order = Cell_Order;
+	h.reorder_interval = Reorder_Interval;
+	h.next_reorder = Next_Reorder;
+	h.step_count = Step_Count;
+	h.use_neighbor_list = Use_Neighbor_List;
+	h.use_symmetric_force = Use_Symmetric_Force;
+	h.use_boundary = Use_Boundary;
+	h.boundary_subdivide = Boundary_Subdivide;
+	h.particles = Number_Particles;
+	h.neighbor_list_valid = Use_Neighbor_List&&Neighbor_List_Valid;
+	h.neighbor_builds = Neighbor_Builds;
+	h.neighbor_steps = Neighbor_Steps;
+	h.neighbor_count = h.neighbor_list_valid ? Neighbor_Start[Number_Particles] : 0;
+
+	const void *arrays[CHECKPOINT_ARRAYS] = {
+		Particles.pos_x, Particles.pos_y, Particles.vel_x, Particles.vel_y,
+		Particles.acc_x, Particles.acc_y, Particles.dens, Particles.pres, Particles.id,
+		List_Pos_x, List_Pos_y, Neighbor_Start, Neighbor_Index
+	};
+	uint64_t sizes[CHECKPOINT_ARRAYS];
+	Array_Sizes(h, sizes);
+	uint64_t offset = Align_Offset(sizeof(Checkpoint_Header));
+	for(int a = 0; a < CHECKPOINT_ARRAYS; a++){
+		h.array_offset[a] = offset;
+		offset = Align_Offset(offset + sizes[a]);
+	}
+	h.file_size = offset;
+
+	// the whole file in one block, the gaps between the arrays are zeros
+	unsigned char *image = (unsigned char *)Aligned_Malloc((size_t)h.file_size);
+	if(image == NULL){
+		printf("Not enough memory for a checkpoint of %llu bytes\n", (unsigned long long)h.file_size);
+		return false;
+	}
+	memset(image, 0, (size_t)h.file_size);
+	for(int a = 0; a < CHECKPOINT_ARRAYS; a++)
+		if(sizes[a] > 0)
+			memcpy(image + h.array_offset[a], arrays[a], (size_t)sizes[a]);
+	h.data_checksum = Checksum(image + sizeof(Checkpoint_Header), (size_t)h.file_size - sizeof(Checkpoint_Header));
+	h.header_checksum = Header_Checksum(h);
+	memcpy(image, &h, sizeof(h));
+
+	char temp_name[1024];
+	snprintf(temp_name, sizeof(temp_name), "%s.tmp", file_name);
+	FILE *file = fopen(temp_name, "wb");
+	if(file == NULL){
+		printf("Can not write %s\n", temp_name);
+		Aligned_Free(image);
+		return false;
+	}
+	bool ok = fwrite(image, 1, (size_t)h.file_size, file) == h.file_size;
+	ok = (fclose(file) == 0)&&ok;
+	Aligned_Free(image);
+	if(!ok||!Replace_File(temp_name, file_name)){
+		printf("Can not write %s\n", file_name);
+		remove(temp_name);
+		return false;
+	}
+	return true;
+}
+
+bool SPH::Load_Checkpoint(const char *file_name){
+	Mapped_File map;
+	if(!map.Open(file_name)){
+		printf("Can not read %s\n", file_name);
+		return false;
+	}
+
+	// check everything before the state is changed, a bad file leaves the simulation as it was
+	Checkpoint_Header h;
+	if(map.size < sizeof(Checkpoint_Header)){
+		printf("%s is not a checkpoint\n", file_name);
+		return false;
+	}
+	memcpy(&h, map.data, sizeof(h));
+	if(memcmp(h.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0){
+		printf("%s is not a checkpoint\n", file_name);
+		return false;
+	}
+	if(h.byte_order != CHECKPOINT_BYTE_ORDER){
+		printf("%s was written on a machine of the other byte order\n", file_name);
+		return false;
+	}
+	if((h.version != CHECKPOINT_VERSION)||(h.header_size != sizeof(Checkpoint_Header))){
+		printf("%s is a checkpoint of version %u, this program reads version %d\n", file_name,
+		       h.version, CHECKPOINT_VERSION);
+		return false;
+	}
+	if(h.header_checksum != Header_Checksum(h)){
+		printf("%s has a damaged header\n", file_name);
+		return false;
+	}
+	if(h.real_size != sizeof(Real)){
+		printf("%s holds %u byte reals, this program uses %u byte reals\n", file_name,
+		       h.real_size, (unsigned)sizeof(Real));
+		return false;
+	}
+	if(h.file_size != map.size){
+		printf("%s is cut short or has a wrong size\n", file_name);
+		return false;
+	}
+	uint64_t sizes[CHECKPOINT_ARRAYS];
+	Array_Sizes(h, sizes);
+	bool fits = (h.particles >= 0)&&(h.neighbor_count >= 0);
+	for(int a = 0; a < CHECKPOINT_ARRAYS; a++)
+		fits = fits&&(h.array_offset[a] >= sizeof(Checkpoint_Header))&&(h.array_offset[a] + sizes[a] <= h.file_size);
+	if(!fits){
+		printf("%s has a damaged header\n", file_name);
+		return false;
+	}
+	if(h.data_checksum != Checksum(map.data + sizeof(Checkpoint_Header), (size_t)(h.file_size - sizeof(Checkpoint_Header)))){
+		printf("%s has damaged particle data\n", file_name);
+		return false;
+	}
+
+	// every handle must have a place in Handle_Index, every neighbor must be a particle
+	const int32_t *ids = (const int32_t *)(map.data + h.array_offset[ARRAY_ID]);
+	const int32_t *neighbors = (const int32_t *)(map.data + h.array_offset[ARRAY_NEIGHBOR_INDEX]);
+	bool valid = true;
+	for(int i = 0; i < h.particles; i++)
+		valid = valid&&(ids[i] >= 0)&&(ids[i] < h.particles);
+	for(int64_t m = 0; m < (h.neighbor_list_valid ? h.neighbor_count : 0); m++)
+		valid = valid&&(neighbors[m] >= 0)&&(neighbors[m] < h.particles);
+	if(!valid){
+		printf("%s has a wrong particle handle or neighbor\n", file_name);
+		return false;
+	}
+
+	// parameters, the grid follows the kernel and the world size
+	kernel = (Real)h.kernel;
+	mass = (Real)h.mass;
+	Cell_Size = kernel;
+	World_Size = Vector2r((Real)h.world_x, (Real)h.world_y);
+	Cell_Order = (Curve_Type)h.cell_order;
+	Init_Grid();
+	World_Size = Grid_Size * Cell_Size;
+	Gravity = Vector2r((Real)h.gravity_x, (Real)h.gravity_y);
+	K = (Real)h.stiffness;
+	Stand_Density = (Real)h.rest_density;
+	Time_Delta = (Real)h.time_delta;
+	Adaptive_Time = h.adaptive_time != 0;
+	Min_Time_Delta = (Real)h.min_time_delta;
+	Max_Time_Delta = (Real)h.max_time_delta;
+	CFL_Number = (Real)h.cfl_number;
+	Simulation_Time = h.simulation_time;
+	Solver = (Pressure_Solver)h.solver;
+	Solver_Tolerance = (Real)h.solver_tolerance;
+	Min_Solver_Iterations = h.min_solver_iterations;
+	Max_Solver_Iterations = h.max_solver_iterations;
+	Total_Solver_Iterations = h.total_solver_iterations;
+	Solver_Iterations = 0;
+	Density_Error = 0.0f;
+	Wall_Hit = (Real)h.wall_hit;
+	Viscosity_Constant = (Real)h.viscosity;
+	Skin = (Real)h.skin;
+	Reorder_Interval = h.reorder_interval;
+	Next_Reorder = h.next_reorder;
+	Step_Count = h.step_count;
+	Use_Neighbor_List = h.use_neighbor_list != 0;
+	Use_Symmetric_Force = h.use_symmetric_force != 0;
+	Use_Boundary = h.use_boundary != 0;
+	Boundary_Subdivide = max((int)h.boundary_subdivide, 1);
+	Boundary_Valid = false;
+	Update_Kernel_Constants();
+
+	// particles, handles are never reused, so the handles are 0 to the particle number
+	Number_Particles = 0;
+	Reserve(h.particles);
+	if(h.neighbor_count > Neighbor_Capacity){
+		Neighbor_Capacity = (int)h.neighbor_count;
+		free(Neighbor_Index);
+		Neighbor_Index = (int *)malloc(sizeof(int) * Neighbor_Capacity);
+	}
+	void *arrays[CHECKPOINT_ARRAYS] = {
+		Particles.pos_x, Particles.pos_y, Particles.vel_x, Particles.vel_y,
+		Particles.acc_x, Particles.acc_y, Particles.dens, Particles.pres, Particles.id,
+		List_Pos_x, List_Pos_y, Neighbor_Start, Neighbor_Index
+	};
+	for(int a = 0; a < CHECKPOINT_ARRAYS; a++)
+		if(sizes[a] > 0)
+			memcpy(arrays[a], map.data + h.array_offset[a], (size_t)sizes[a]);
+	Number_Particles = h.particles;
+	for(int i = 0; i < Number_Particles; i++){
+		Particles.cell[i] = -1;
+		Handle_Index[Particles.id[i]] = i;
+	}
+	Neighbor_List_Valid = h.neighbor_list_valid != 0;
+	Neighbor_Builds = h.neighbor_builds;
+	Neighbor_Steps = h.neighbor_steps;
+	Timing.Reset();
+	return true;
+}
@@ -1,25 +1,173 @@
 #ifndef __DATASTRUCTURE_H__
 #define __DATASTRUCTURE_H__
 
+#include <stdlib.h>
+#include "AlignedMemory.h"
 #include "ObjLibrary/Vector2.h"
+#include "Vector2f.h"
 
+// simulation precision, define SPH_DOUBLE_PRECISION to use doubles
+#ifdef SPH_DOUBLE_PRECISION
+typedef double Real;
+typedef Vector2 Vector2r;
+#else
+typedef float Real;
+typedef Vector2f Vector2r;
+#endif
+
+// one particle as a struct, only used as a view for the display
 class Particle
 {
 public:
-	Vector2 pos;		// position
-	Vector2 vel;		// velocity
-	Vector2 acc;		// acceleration
+	Vector2r pos;		// position
+	Vector2r vel;		// velocity
+	Vector2r acc;		// acceleration
+
+	Real dens;			// density
+	Real pres;			// pressure
+};
+
+// a particle handle stays valid when the arrays grow or the particles are sorted
+typedef int Particle_Handle;
+
+// all particles stored as separate contiguous arrays (structure of arrays),
+// every array is aligned to a cache line
+class Particle_Arrays
+{
+public:
+	Real *pos_x;		// position
+	Real *pos_y;
+	Real *vel_x;		// velocity
+	Real *vel_y;
+	Real *acc_x;		// acceleration
+	Real *acc_y;
+
+	Real *dens;			// density
+	Real *pres;			// pressure
+
+	int *cell;			// cell hash of the particle
+	int *id;			// handle of the particle, it stays the same when the particle moves in memory
+
+	int capacity;		// room in every array
+
+	Particle_Arrays(){
+		pos_x = pos_y = vel_x = vel_y = acc_x = acc_y = dens = pres = NULL;
+		cell = id = NULL;
+		capacity = 0;
+	}
+
+	// grow every array to new_capacity particles, keeping the first count
+	void Reserve(int new_capacity, int count){
+		if(new_capacity <= capacity)
+			return;
+		Aligned_Grow(pos_x, count, new_capacity);
+		Aligned_Grow(pos_y, count, new_capacity);
+		Aligned_Grow(vel_x, count, new_capacity);
+		Aligned_Grow(vel_y, count, new_capacity);
+		Aligned_Grow(acc_x, count, new_capacity);
+		Aligned_Grow(acc_y, count, new_capacity);
+		Aligned_Grow(dens, count, new_capacity);
+		Aligned_Grow(pres, count, new_capacity);
+		Aligned_Grow(cell, count, new_capacity);
+		Aligned_Grow(id, count, new_capacity);
+		capacity = new_capacity;
+	}
+
+	// copy particle s of src to particle d
+	void Copy(int d, const Particle_Arrays &src, int s){
+		pos_x[d] = src.pos_x[s];
+		pos_y[d] = src.pos_y[s];
+		vel_x[d] = src.vel_x[s];
+		vel_y[d] = src.vel_y[s];
+		acc_x[d] = src.acc_x[s];
+		acc_y[d] = src.acc_y[s];
+		dens[d] = src.dens[s];
+		pres[d] = src.pres[s];
+		cell[d] = src.cell[s];
+		id[d] = src.id[s];
+	}
+
+	void Free(){
+		Aligned_Free(pos_x);
+		Aligned_Free(pos_y);
+		Aligned_Free(vel_x);
+		Aligned_Free(vel_y);
+		Aligned_Free(acc_x);
+		Aligned_Free(acc_y);
+		Aligned_Free(dens);
+		Aligned_Free(pres);
+		Aligned_Free(cell);
+		Aligned_Free(id);
+		capacity = 0;
+	}
+};
+
+// scratch arrays of the iterative pressure solvers, only valid during a step
+class Solver_Arrays
+{
+public:
+	Real *vel_x;		// velocity without the pressure force, predicted velocity (PCISPH)
+	Real *vel_y;
+	Real *d_x;			// displacement by the own pressure (IISPH), predicted position (PCISPH)
+	Real *d_y;
+	Real *sum_x;		// displacement by the neighbor pressures (IISPH), pressure acceleration (PCISPH)
+	Real *sum_y;
+	Real *diag;			// diagonal of the pressure equation (IISPH)
+	Real *dens;			// density without the pressure force, predicted density (PCISPH)
+	Real *pres;			// pressure of the current iteration
+	Real *pres_new;		// pressure of the next iteration
+	Real *wall_x;		// gradient of the wall density at the predicted position (PCISPH)
+	Real *wall_y;
+
+	int capacity;
+
+	Solver_Arrays(){
+		vel_x = vel_y = d_x = d_y = sum_x = sum_y = diag = dens = pres = pres_new = wall_x = wall_y = NULL;
+		capacity = 0;
+	}
 
-	float dens;			// density
-	float pres;			// pressure
+	// the content is not kept
+	void Reserve(int new_capacity){
+		if(new_capacity <= capacity)
+			return;
+		Aligned_Grow(vel_x, 0, new_capacity);
+		Aligned_Grow(vel_y, 0, new_capacity);
+		Aligned_Grow(d_x, 0, new_capacity);
+		Aligned_Grow(d_y, 0, new_capacity);
+		Aligned_Grow(sum_x, 0, new_capacity);
+		Aligned_Grow(sum_y, 0, new_capacity);
+		Aligned_Grow(diag, 0, new_capacity);
+		Aligned_Grow(dens, 0, new_capacity);
+		Aligned_Grow(pres, 0, new_capacity);
+		Aligned_Grow(pres_new, 0, new_capacity);
+		Aligned_Grow(wall_x, 0, new_capacity);
+		Aligned_Grow(wall_y, 0, new_capacity);
+		capacity = new_capacity;
+	}
 
-	Particle *next;		// link list
+	void Free(){
+		Aligned_Free(vel_x);
+		Aligned_Free(vel_y);
+		Aligned_Free(d_x);
+		Aligned_Free(d_y);
+		Aligned_Free(sum_x);
+		Aligned_Free(sum_y);
+		Aligned_Free(diag);
+		Aligned_Free(dens);
+		Aligned_Free(pres);
+		Aligned_Free(pres_new);
+		Aligned_Free(wall_x);
+		Aligned_Free(wall_y);
+		capacity = 0;
+	}
 };
 
+// particles are sorted by cell, so a cell is the index range [start, end)
 class Cell
 {
 public:
-	Particle *head;		// the cell is head of the link list
+	int start;			// index of the first particle in the cell
+	int end;			// one past the last particle in the cell
 };
 
 #endif
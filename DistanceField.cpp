@@ -0,0 +1,118 @@
+//
+//  DistanceField.cpp
+//
+
+#include "DistanceField.h"
+#include <math.h>
+#include <chrono>
+#include <algorithm>
+
+using namespace std;
+
+#define FIELD_LATTICE 8			// points of the fine lattice per kernel
+
+Distance_Field::Distance_Field(){
+	Nodes_X = Nodes_Y = 0;
+	Low = Vector2r(0.0f, 0.0f);
+	Spacing = Inverse_Spacing = 0.0f;
+	Far = 0.0f;
+	Baked = false;
+	Bake_Seconds = 0.0;
+}
+
+void Distance_Field::Init_Box(Vector2r size, Real spacing, Real margin){
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	int outside = (int)ceil(margin / spacing);			// nodes outside the box on every side
+	Spacing = spacing;
+	Inverse_Spacing = 1.0f / spacing;
+	Low = Vector2r(-outside * spacing, -outside * spacing);
+	Nodes_X = (int)(size.x / spacing + 0.5f) + 2 * outside + 1;
+	Nodes_Y = (int)(size.y / spacing + 0.5f) + 2 * outside + 1;
+	Nodes.resize((size_t)Nodes_X * Nodes_Y);
+	for(int j = 0; j < Nodes_Y; j++)
+		for(int i = 0; i < Nodes_X; i++){
+			Real x = Low.x + i * spacing;
+			Real y = Low.y + j * spacing;
+			Field_Node &n = Nodes[(size_t)j * Nodes_X + i];
+			n.distance = min(min(x, size.x - x), min(y, size.y - y));
+			n.dens = n.grad_x = n.grad_y = 0.0f;
+		}
+	Baked = false;
+	Bake_Seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void Distance_Field::Add_Obstacle(const Obstacle &o, int threads){
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	Vector2r low = o.Get_Low();
+	Vector2r high = o.Get_High();
+	#pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+	for(int j = 0; j < Nodes_Y; j++)
+		for(int i = 0; i < Nodes_X; i++){
+			Field_Node &n = Nodes[(size_t)j * Nodes_X + i];
+			Vector2r p(Low.x + i * Spacing, Low.y + j * Spacing);
+			// the obstacle is no nearer than its bounding box
+			Real dx = max(max(low.x - p.x, p.x - high.x), (Real)0.0f);
+			Real dy = max(max(low.y - p.y, p.y - high.y), (Real)0.0f);
+			if(dx * dx + dy * dy >= n.distance * n.distance)
+				continue;
+			n.distance = min(n.distance, o.Distance(p));
+		}
+	Baked = false;
+	Bake_Seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void Distance_Field::Bake(const Kernel_Constants &c, Real rest_density, int threads){
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	// the points of the fine lattice within the kernel of a node, with their kernels
+	Real step = c.kernel / FIELD_LATTICE;
+	vector<Real> offset_x, offset_y, poly6, grad_x, grad_y;
+	Real full = 0.0f;
+	for(int a = -FIELD_LATTICE; a <= FIELD_LATTICE; a++)
+		for(int b = -FIELD_LATTICE; b <= FIELD_LATTICE; b++){
+			Real ox = a * step;
+			Real oy = b * step;
+			Real r2 = ox * ox + oy * oy;
+			if(r2 >= c.kernel2)
+				continue;
+			Real r = sqrt(r2);
+			// the gradient at the node of the kernel around the point, towards the point
+			Real g = r2 > 0.0f ? -Kernel_Spiky(c, r) / r : 0.0f;
+			offset_x.push_back(ox);
+			offset_y.push_back(oy);
+			poly6.push_back(Kernel_Poly6(c, r2));
+			grad_x.push_back(g * ox);
+			grad_y.push_back(g * oy);
+			full += Kernel_Poly6(c, r2);
+		}
+	int points = (int)offset_x.size();
+	Real weight = rest_density / full;			// a node with every point inside gets the rest density
+	Far = c.kernel + 1.5f * Spacing;
+
+	#pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+	for(int j = 0; j < Nodes_Y; j++)
+		for(int i = 0; i < Nodes_X; i++){
+			Field_Node &n = Nodes[(size_t)j * Nodes_X + i];
+			n.dens = n.grad_x = n.grad_y = 0.0f;
+			if(n.distance >= c.kernel + step)
+				continue;
+			if(n.distance <= -c.kernel - step){		// every point inside
+				n.dens = rest_density;
+				continue;
+			}
+			Real x = Low.x + i * Spacing;
+			Real y = Low.y + j * Spacing;
+			Real dens = 0.0f, gx = 0.0f, gy = 0.0f;
+			for(int k = 0; k < points; k++){
+				// a point on the surface is half inside, so the walls do not move with the lattice
+				Real inside = min(max(0.5f - Distance(x + offset_x[k], y + offset_y[k]) / step, (Real)0.0f), (Real)1.0f);
+				dens += inside * poly6[k];
+				gx += inside * grad_x[k];
+				gy += inside * grad_y[k];
+			}
+			n.dens = weight * dens;
+			n.grad_x = weight * gx;
+			n.grad_y = weight * gy;
+		}
+	Baked = true;
+	Bake_Seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,133 @@
+//
+//  DistanceField.h
+//
+//  The walls as a signed distance field on a grid of nodes
+//    aligned with the cells, baked once and sampled bilinearly
+//    in the step.  The distance is positive in the fluid and
+//    negative inside the walls.
+//
+//  Every node also keeps the density the walls add to a
+//    particle there and its gradient, as if the walls were
+//    fluid at rest (density maps of Koschier and Bender 2017).
+//    They are sums of the kernels over a fine lattice of
+//    points inside the walls, each point weighted by how much
+//    of it is inside, and scaled so a node deep inside a wall
+//    gets the rest density.  The gradient uses the spiky kernel
+//    like the pressure force.  So a particle feels the walls
+//    through its density and pressure like any other neighbor,
+//    and corners add the density of both walls.
+//
+//  Obstacles are added to the box before baking, every node
+//    keeps the smaller of the two distances.  Their distances
+//    are only asked once per node, so the solver never looks
+//    at the polygons.
+//
+
+#ifndef __DISTANCEFIELD_H__
+#define __DISTANCEFIELD_H__
+
+#include <vector>
+#include "DataStructure.h"
+#include "Kernel.h"
+#include "Obstacle.h"
+
+// the field at one node
+class Field_Node
+{
+public:
+	Real distance;		// to the nearest wall, negative inside the walls
+	Real dens;			// density the walls add
+	Real grad_x;		// its gradient
+	Real grad_y;
+};
+
+class Distance_Field
+{
+public:
+	Distance_Field();
+
+	// nodes every spacing from -margin to size + margin, with the distances to the walls of
+	// a box from 0 to size, the world of the solver
+	void Init_Box(Vector2r size, Real spacing, Real margin);
+	// the solid of o becomes part of the walls, Bake again after it
+	void Add_Obstacle(const Obstacle &o, int threads);
+	// the wall density and its gradient of every node within the kernel of a wall
+	void Bake(const Kernel_Constants &c, Real rest_density, int threads);
+
+	// bilinear samples, outside the nodes the border nodes are used
+	Real Distance(Real x, Real y) const{
+		Real fx, fy;
+		const Field_Node *n = Locate(x, y, fx, fy);
+		return Mix(n[0].distance, n[1].distance, n[Nodes_X].distance, n[Nodes_X + 1].distance, fx, fy);
+	}
+
+	// gradient of the distance, the direction away from the nearest wall, not normalized
+	Vector2r Distance_Gradient(Real x, Real y) const{
+		Real fx, fy;
+		const Field_Node *n = Locate(x, y, fx, fy);
+		Real bottom = n[1].distance - n[0].distance;
+		Real top = n[Nodes_X + 1].distance - n[Nodes_X].distance;
+		Real left = n[Nodes_X].distance - n[0].distance;
+		Real right = n[Nodes_X + 1].distance - n[1].distance;
+		return Vector2r((bottom + (top - bottom) * fy) * Inverse_Spacing, (left + (right - left) * fx) * Inverse_Spacing);
+	}
+
+	// wall density and gradient, false and nothing written where no wall is within the kernel
+	bool Sample(Real x, Real y, Real &dens, Real &grad_x, Real &grad_y) const{
+		Real fx, fy;
+		const Field_Node *n = Locate(x, y, fx, fy);
+		if(n[0].distance > Far)			// the whole square is away from the walls
+			return false;
+		const Field_Node *u = n + Nodes_X;
+		dens = Mix(n[0].dens, n[1].dens, u[0].dens, u[1].dens, fx, fy);
+		grad_x = Mix(n[0].grad_x, n[1].grad_x, u[0].grad_x, u[1].grad_x, fx, fy);
+		grad_y = Mix(n[0].grad_y, n[1].grad_y, u[0].grad_y, u[1].grad_y, fx, fy);
+		return true;
+	}
+
+	bool Is_Baked() const{
+		return Baked;
+	}
+
+	int Get_Node_Number() const{
+		return (int)Nodes.size();
+	}
+
+	// time to set up, add the obstacles and bake
+	double Get_Bake_Seconds() const{
+		return Bake_Seconds;
+	}
+
+private:
+	std::vector<Field_Node> Nodes;			// row by row from the bottom left
+	int Nodes_X, Nodes_Y;
+	Vector2r Low;							// position of the first node
+	Real Spacing;
+	Real Inverse_Spacing;
+	Real Far;								// a node further than this has no wall within the kernel of its square
+	bool Baked;
+	double Bake_Seconds;
+
+	// bottom left node of the square around (x, y) and the position in it from 0 to 1
+	const Field_Node* Locate(Real x, Real y, Real &fx, Real &fy) const{
+		Real gx = (x - Low.x) * Inverse_Spacing;
+		Real gy = (y - Low.y) * Inverse_Spacing;
+		gx = gx < 0.0f ? 0.0f : (gx > Nodes_X - 1 ? (Real)(Nodes_X - 1) : gx);
+		gy = gy < 0.0f ? 0.0f : (gy > Nodes_Y - 1 ? (Real)(Nodes_Y - 1) : gy);
+		int i = (int)gx;
+		int j = (int)gy;
+		if(i > Nodes_X - 2) i = Nodes_X - 2;
+		if(j > Nodes_Y - 2) j = Nodes_Y - 2;
+		fx = gx - i;
+		fy = gy - j;
+		return &Nodes[(size_t)j * Nodes_X + i];
+	}
+
+	static Real Mix(Real v00, Real v10, Real v01, Real v11, Real fx, Real fy){
+		Real bottom = v00 + (v10 - v00) * fx;
+		Real top = v01 + (v11 - v01) * fx;
+		return bottom + (top - bottom) * fy;
+	}
+};
+
+#endif
@@ -0,0 +1,523 @@
+//
+//  FrameCodec.cpp
+//
+
+#include "FrameCodec.h"
+#include "SpaceFillingCurve.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+#define POSITION_LEVELS 65535		// quantization steps across the world
+#define VELOCITY_LEVELS 32767		// steps from 0 to the velocity range
+#define VELOCITY_HEADROOM 1.5f		// range of a key frame over its fastest particle
+#define RANS_SCALE_BITS 12			// the frequencies of a plane add up to 1 << RANS_SCALE_BITS
+#define RANS_LOW (1u << 23)			// the state is kept in [RANS_LOW, RANS_LOW << 8)
+
+// signed residuals as unsigned numbers with the small ones first, 0, -1, 1, -2, ...
+static inline uint32_t Zigzag(int32_t v){
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t Unzigzag(uint32_t u){
+	return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+static void Put_U16(vector<unsigned char> &out, uint32_t v){
+	out.push_back((unsigned char)v);
+	out.push_back((unsigned char)(v >> 8));
+}
+
+static void Put_U32(vector<unsigned char> &out, uint32_t v){
+	for(int b = 0; b < 4; b++)
+		out.push_back((unsigned char)(v >> (8 * b)));
+}
+
+// reads from p up to end, every read fails once the data is used up
+class Byte_Reader
+{
+public:
+	const unsigned char *p;
+	const unsigned char *end;
+
+	Byte_Reader(const unsigned char *begin, const unsigned char *stop) : p(begin), end(stop)
+	{}
+
+	bool Get_U8(uint32_t &v){
+		if(end - p < 1)
+			return false;
+		v = *p++;
+		return true;
+	}
+
+	bool Get_U16(uint32_t &v){
+		if(end - p < 2)
+			return false;
+		v = p[0] | (p[1] << 8);
+		p += 2;
+		return true;
+	}
+
+	bool Get_U32(uint32_t &v){
+		if(end - p < 4)
+			return false;
+		v = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+		p += 4;
+		return true;
+	}
+};
+
+// frequencies of the symbols scaled to add up to 1 << RANS_SCALE_BITS, every used symbol keeps at least 1
+static void Normalize_Frequencies(const uint32_t count[256], uint32_t total, uint32_t freq[256]){
+	const int32_t scale = 1 << RANS_SCALE_BITS;
+	int32_t sum = 0;
+	for(int s = 0; s < 256; s++){
+		freq[s] = 0;
+		if(count[s] > 0){
+			freq[s] = max((uint32_t)((uint64_t)count[s] * scale / total), 1u);
+			sum += freq[s];
+		}
+	}
+	// the rounding error goes to the largest symbols, which lose the least by it
+	while(sum != scale){
+		int largest = 0;
+		for(int s = 1; s < 256; s++)
+			if(freq[s] > freq[largest])
+				largest = s;
+		if(sum < scale){
+			freq[largest] += scale - sum;
+			sum = scale;
+		}
+		else{
+			int32_t take = min(sum - scale, (int32_t)freq[largest] - 1);
+			freq[largest] -= take;
+			sum -= take;
+		}
+	}
+}
+
+// one byte plane: the symbol table, then the rANS data, a plane of one symbol needs no data
+static void Encode_Plane(const unsigned char *symbols, int n, vector<unsigned char> &out){
+	uint32_t count[256] = {0};
+	for(int i = 0; i < n; i++)
+		count[symbols[i]]++;
+	int used = 0;
+	for(int s = 0; s < 256; s++)
+		used += count[s] > 0;
+	Put_U16(out, used);
+	if(used <= 1){
+		out.push_back(n > 0 ? symbols[0] : 0);
+		return;
+	}
+
+	uint32_t freq[256], start[256];
+	Normalize_Frequencies(count, n, freq);
+	for(int s = 0, c = 0; s < 256; s++){
+		start[s] = c;
+		c += freq[s];
+		if(freq[s] > 0){
+			out.push_back((unsigned char)s);
+			Put_U16(out, freq[s]);
+		}
+	}
+
+	// the symbols are coded backwards so they decode forwards, the bytes come out reversed
+	vector<unsigned char> data;
+	data.reserve(n + 4);
+	uint32_t x = RANS_LOW;
+	for(int i = n - 1; i >= 0; i--){
+		uint32_t s = symbols[i];
+		uint32_t limit = ((RANS_LOW >> RANS_SCALE_BITS) << 8) * freq[s];
+		while(x >= limit){
+			data.push_back((unsigned char)x);
+			x >>= 8;
+		}
+		x = ((x / freq[s]) << RANS_SCALE_BITS) + (x % freq[s]) + start[s];
+	}
+	for(int b = 3; b >= 0; b--)
+		data.push_back((unsigned char)(x >> (8 * b)));
+	reverse(data.begin(), data.end());
+	Put_U32(out, (uint32_t)data.size());
+	out.insert(out.end(), data.begin(), data.end());
+}
+
+static bool Decode_Plane(Byte_Reader &in, unsigned char *symbols, int n){
+	uint32_t used;
+	if(!in.Get_U16(used)||(used > 256))
+		return false;
+	if(used <= 1){
+		uint32_t s;
+		if(!in.Get_U8(s))
+			return false;
+		memset(symbols, (int)s, n);
+		return true;
+	}
+
+	const uint32_t scale = 1 << RANS_SCALE_BITS;
+	uint32_t freq[256] = {0}, start[256] = {0};
+	unsigned char slot_symbol[1 << RANS_SCALE_BITS];
+	uint32_t c = 0;
+	for(uint32_t k = 0; k < used; k++){
+		uint32_t s, f;
+		if(!in.Get_U8(s)||!in.Get_U16(f)||(f == 0)||(c + f > scale))
+			return false;
+		freq[s] = f;
+		start[s] = c;
+		memset(slot_symbol + c, (int)s, f);
+		c += f;
+	}
+	uint32_t bytes, x;
+	if((c != scale)||!in.Get_U32(bytes)||(bytes < 4)||((uint32_t)(in.end - in.p) < bytes))
+		return false;
+	Byte_Reader data(in.p, in.p + bytes);
+	in.p += bytes;
+	data.Get_U32(x);
+	for(int i = 0; i < n; i++){
+		uint32_t slot = x & (scale - 1);
+		uint32_t s = slot_symbol[slot];
+		symbols[i] = (unsigned char)s;
+		x = freq[s] * (x >> RANS_SCALE_BITS) + slot - start[s];
+		while(x < RANS_LOW){
+			uint32_t b;
+			if(!data.Get_U8(b))
+				return false;
+			x = (x << 8) | b;
+		}
+	}
+	return true;
+}
+
+// unsigned values as byte planes, only as many planes as the largest value needs
+static void Encode_Values(const uint32_t *values, int n, vector<unsigned char> &out){
+	uint32_t largest = 0;
+	for(int i = 0; i < n; i++)
+		largest |= values[i];
+	int planes = 0;
+	while((planes < 4)&&((largest >> (8 * planes)) != 0))
+		planes++;
+	out.push_back((unsigned char)planes);
+	vector<unsigned char> plane(n);
+	for(int b = 0; b < planes; b++){
+		for(int i = 0; i < n; i++)
+			plane[i] = (unsigned char)(values[i] >> (8 * b));
+		Encode_Plane(plane.data(), n, out);
+	}
+}
+
+static bool Decode_Values(Byte_Reader &in, uint32_t *values, int n){
+	uint32_t planes;
+	if(!in.Get_U8(planes)||(planes > 4))
+		return false;
+	memset(values, 0, sizeof(uint32_t) * n);
+	vector<unsigned char> plane(n);
+	for(uint32_t b = 0; b < planes; b++){
+		if(!Decode_Plane(in, plane.data(), n))
+			return false;
+		for(int i = 0; i < n; i++)
+			values[i] |= (uint32_t)plane[i] << (8 * b);
+	}
+	return true;
+}
+
+static inline int32_t Quantize(float v, float range, int32_t levels, int32_t low){
+	int32_t q = (int32_t)floorf(v / range * levels + 0.5f);
+	return min(max(q, low), levels);
+}
+
+void Codec_Report::Print(FILE *file) const{
+	double values = (double)max(particles, 1LL);
+	fprintf(file, "frames %lld, key frames %lld, %.2f bits per particle\n", frames, key_frames,
+	        coded_bytes * 8.0 / values);
+	fprintf(file, "%.1f MB coded, %.1f times smaller than floats, %.1f times smaller than Particle structs\n",
+	        coded_bytes / 1e6, coded_bytes > 0 ? (double)raw_bytes / coded_bytes : 0.0,
+	        coded_bytes > 0 ? (double)struct_bytes / coded_bytes : 0.0);
+	fprintf(file, "position error max %.3g, rms %.3g\n", max_position_error, sqrt(position_error2 / (2.0 * values)));
+	if(velocity_error2 > 0.0)
+		fprintf(file, "velocity error max %.3g, rms %.3g\n", max_velocity_error, sqrt(velocity_error2 / (2.0 * values)));
+}
+
+Frame_Encoder::Frame_Encoder(Vector2r world, uint32_t fields, int key_interval){
+	World = world;
+	Fields = FIELD_POSITION | FIELD_ID | (fields & FIELD_VELOCITY);
+	Key_Interval = max(key_interval, 1);
+	Since_Key = 0;
+	History = 0;
+	Velocity_Range = 0.0f;
+	memset(&Report, 0, sizeof(Report));
+}
+
+uint32_t Frame_Encoder::Get_Fields(){
+	return Fields;
+}
+
+const Codec_Report& Frame_Encoder::Get_Report(){
+	return Report;
+}
+
+void Frame_Encoder::Encode_Header(int stride, vector<unsigned char> &out){
+	Codec_File_Header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CODEC_MAGIC, sizeof(CODEC_MAGIC));
+	h.version = CODEC_VERSION;
+	h.fields = Fields;
+	h.world_x = (float)World.x;
+	h.world_y = (float)World.y;
+	h.key_interval = Key_Interval;
+	h.stride = stride;
+	out.assign((const unsigned char *)&h, (const unsigned char *)&h + sizeof(h));
+	Report.coded_bytes += sizeof(h);
+}
+
+void Frame_Encoder::Encode(const unsigned char *frame, vector<unsigned char> &out){
+	const Frame_Header &f = *(const Frame_Header *)frame;
+	int n = f.particles;
+	bool velocity = (Fields & FIELD_VELOCITY) != 0;
+	const float *px = (const float *)Get_Frame_Field(frame, FIELD_POSITION, 0);
+	const float *py = (const float *)Get_Frame_Field(frame, FIELD_POSITION, 1);
+	const float *vx = (const float *)Get_Frame_Field(frame, FIELD_VELOCITY, 0);
+	const float *vy = (const float *)Get_Frame_Field(frame, FIELD_VELOCITY, 1);
+	const int32_t *id = (const int32_t *)Get_Frame_Field(frame, FIELD_ID, 0);
+
+	float fastest = 0.0f;
+	if(velocity)
+		for(int i = 0; i < n; i++)
+			fastest = max(fastest, max(fabsf(vx[i]), fabsf(vy[i])));
+	bool key = (History == 0)||(Since_Key >= Key_Interval)||(n != (int)Order.size())||
+	           (velocity&&(fastest > Velocity_Range));
+	int32_t largest_id = -1;
+	for(int i = 0; i < n; i++){
+		largest_id = max(largest_id, id[i]);
+		// a handle the last key frame did not have
+		if(!key&&((id[i] < 0)||(id[i] >= (int32_t)Slot.size())||(Slot[id[i]] < 0)))
+			key = true;
+	}
+
+	for(int c = 0; c < 4; c++)
+		Current[c].resize(n);
+	float wx = (float)World.x;
+	float wy = (float)World.y;
+	if(key){
+		// the order of the key frame is the Morton order of the quantized positions
+		vector<unsigned int> keys(2 * n);
+		vector<int> index(2 * n);
+		for(int i = 0; i < n; i++){
+			keys[i] = Morton_Encode(Quantize(px[i], wx, POSITION_LEVELS, 0), Quantize(py[i], wy, POSITION_LEVELS, 0));
+			index[i] = i;
+		}
+		Radix_Sort(keys.data(), index.data(), n, keys.data() + n, index.data() + n, 0xFFFFFFFFu);
+		Order.resize(n);
+		Slot.assign(largest_id + 1, -1);
+		for(int k = 0; k < n; k++){
+			Order[k] = id[index[k]];
+			Slot[Order[k]] = k;
+		}
+		Velocity_Range = max(fastest * VELOCITY_HEADROOM, 1e-3f);
+	}
+
+	// quantized values of every particle at its place in the order
+	for(int i = 0; i < n; i++){
+		int k = Slot[id[i]];
+		Current[0][k] = Quantize(px[i], wx, POSITION_LEVELS, 0);
+		Current[1][k] = Quantize(py[i], wy, POSITION_LEVELS, 0);
+		double ex = fabs(Current[0][k] * (double)wx / POSITION_LEVELS - px[i]);
+		double ey = fabs(Current[1][k] * (double)wy / POSITION_LEVELS - py[i]);
+		Report.max_position_error = max(Report.max_position_error, max(ex, ey));
+		Report.position_error2 += ex * ex + ey * ey;
+		if(velocity){
+			Current[2][k] = Quantize(vx[i], Velocity_Range, VELOCITY_LEVELS, -VELOCITY_LEVELS);
+			Current[3][k] = Quantize(vy[i], Velocity_Range, VELOCITY_LEVELS, -VELOCITY_LEVELS);
+			double evx = fabs(Current[2][k] * (double)Velocity_Range / VELOCITY_LEVELS - vx[i]);
+			double evy = fabs(Current[3][k] * (double)Velocity_Range / VELOCITY_LEVELS - vy[i]);
+			Report.max_velocity_error = max(Report.max_velocity_error, max(evx, evy));
+			Report.velocity_error2 += evx * evx + evy * evy;
+		}
+	}
+
+	Codec_Frame_Header h;
+	memcpy(h.tag, key ? "KEYF" : "DELF", 4);
+	h.step = f.step;
+	h.particles = n;
+	h.velocity_range = Velocity_Range;
+	h.time = f.time;
+	h.bytes = 0;
+	out.assign((const unsigned char *)&h, (const unsigned char *)&h + sizeof(h));
+
+	// key frames: handles and values as differences along the curve,
+	// other frames: values as differences from the prediction of the last frames
+	Residual.resize(n);
+	if(key){
+		for(int k = 0; k < n; k++)
+			Residual[k] = Zigzag(Order[k] - (k > 0 ? Order[k - 1] : 0));
+		Encode_Values(Residual.data(), n, out);
+	}
+	int components = velocity ? 4 : 2;
+	for(int c = 0; c < components; c++){
+		const vector<int32_t> &now = Current[c];
+		for(int k = 0; k < n; k++){
+			int32_t predicted;
+			if(key)
+				predicted = k > 0 ? now[k - 1] : 0;
+			else if((c < 2)&&(History >= 2))
+				predicted = 2 * Last[c][k] - Before[c][k];		// the same velocity as in the last step
+			else
+				predicted = Last[c][k];
+			Residual[k] = Zigzag(now[k] - predicted);
+		}
+		Encode_Values(Residual.data(), n, out);
+	}
+	((Codec_Frame_Header *)out.data())->bytes = out.size() - sizeof(h);
+
+	History = key ? 1 : min(History + 1, 2);
+	Since_Key = key ? 1 : Since_Key + 1;
+	for(int c = 0; c < 2; c++)
+		Before[c].swap(Last[c]);
+	for(int c = 0; c < 4; c++)
+		Last[c].swap(Current[c]);
+
+	Report.frames++;
+	Report.key_frames += key;
+	Report.particles += n;
+	Report.raw_bytes += sizeof(Frame_Header) + Get_Frame_Bytes(Fields, n);
+	Report.struct_bytes += (long long)n * sizeof(Particle);
+	Report.coded_bytes += out.size();
+}
+
+Frame_Decoder::Frame_Decoder(){
+	File = NULL;
+	Damaged = false;
+	History = 0;
+	memset(&Header, 0, sizeof(Header));
+}
+
+Frame_Decoder::~Frame_Decoder(){
+	Close();
+}
+
+bool Frame_Decoder::Open(const char *file_name){
+	Close();
+	File = fopen(file_name, "rb");
+	if(File == NULL){
+		printf("Can not read %s\n", file_name);
+		return false;
+	}
+	if((fread(&Header, sizeof(Header), 1, File) != 1)||(memcmp(Header.magic, CODEC_MAGIC, sizeof(CODEC_MAGIC)) != 0)){
+		printf("%s is not a coded frame stream\n", file_name);
+		Close();
+		return false;
+	}
+	if(Header.version != CODEC_VERSION){
+		printf("%s is a coded frame stream of version %u, this program reads version %d\n", file_name,
+		       Header.version, CODEC_VERSION);
+		Close();
+		return false;
+	}
+	Damaged = false;
+	History = 0;
+	return true;
+}
+
+void Frame_Decoder::Close(){
+	if(File != NULL)
+		fclose(File);
+	File = NULL;
+}
+
+const Codec_File_Header& Frame_Decoder::Get_Header(){
+	return Header;
+}
+
+bool Frame_Decoder::Is_Damaged(){
+	return Damaged;
+}
+
+bool Frame_Decoder::Read(Decoded_Frame &frame){
+	Codec_Frame_Header h;
+	if((File == NULL)||Damaged)
+		return false;
+	size_t got = fread(&h, 1, sizeof(h), File);
+	if(got != sizeof(h)){
+		// nothing left is the end of the stream, part of a header is not
+		if((got > 0)||ferror(File)){
+			printf("Frame header is cut off\n");
+			Damaged = true;
+		}
+		return false;
+	}
+	bool key = memcmp(h.tag, "KEYF", 4) == 0;
+	if((!key&&(memcmp(h.tag, "DELF", 4) != 0))||(h.particles < 0)||(h.bytes > ((uint64_t)h.particles + 64) * 128)){
+		printf("Damaged frame in the stream\n");
+		Damaged = true;
+		return false;
+	}
+	if(!key&&((History == 0)||(h.particles != (int)Order.size()))){
+		printf("Frame of step %d has no key frame before it\n", h.step);
+		Damaged = true;
+		return false;
+	}
+	Buffer.resize((size_t)h.bytes);
+	if(fread(Buffer.data(), 1, Buffer.size(), File) != Buffer.size()){
+		printf("Frame of step %d is cut off\n", h.step);
+		Damaged = true;
+		return false;
+	}
+
+	int n = h.particles;
+	bool velocity = (Header.fields & FIELD_VELOCITY) != 0;
+	int components = velocity ? 4 : 2;
+	Byte_Reader in(Buffer.data(), Buffer.data() + Buffer.size());
+	Residual.resize(n);
+	bool ok = true;
+	if(key){
+		ok = Decode_Values(in, Residual.data(), n);
+		Order.resize(n);
+		for(int k = 0; ok&&(k < n); k++)
+			Order[k] = (k > 0 ? Order[k - 1] : 0) + Unzigzag(Residual[k]);
+	}
+	vector<int32_t> now[4];
+	for(int c = 0; ok&&(c < components); c++){
+		ok = Decode_Values(in, Residual.data(), n);
+		now[c].resize(n);
+		for(int k = 0; ok&&(k < n); k++){
+			int32_t predicted;
+			if(key)
+				predicted = k > 0 ? now[c][k - 1] : 0;
+			else if((c < 2)&&(History >= 2))
+				predicted = 2 * Last[c][k] - Before[c][k];
+			else
+				predicted = Last[c][k];
+			now[c][k] = predicted + Unzigzag(Residual[k]);
+		}
+	}
+	if(!ok){
+		printf("Damaged frame of step %d in the stream\n", h.step);
+		Damaged = true;
+		History = 0;
+		return false;
+	}
+
+	History = key ? 1 : min(History + 1, 2);
+	for(int c = 0; c < 2; c++)
+		Before[c].swap(Last[c]);
+	for(int c = 0; c < components; c++)
+		Last[c].swap(now[c]);
+
+	frame.step = h.step;
+	frame.time = h.time;
+	frame.key = key;
+	frame.id = Order;
+	frame.pos_x.resize(n);
+	frame.pos_y.resize(n);
+	for(int k = 0; k < n; k++){
+		frame.pos_x[k] = (float)(Last[0][k] * (double)Header.world_x / POSITION_LEVELS);
+		frame.pos_y[k] = (float)(Last[1][k] * (double)Header.world_y / POSITION_LEVELS);
+	}
+	frame.vel_x.resize(velocity ? n : 0);
+	frame.vel_y.resize(velocity ? n : 0);
+	for(int k = 0; velocity&&(k < n); k++){
+		frame.vel_x[k] = (float)(Last[2][k] * (double)h.velocity_range / VELOCITY_LEVELS);
+		frame.vel_y[k] = (float)(Last[3][k] * (double)h.velocity_range / VELOCITY_LEVELS);
+	}
+	return true;
+}
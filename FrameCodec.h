@@ -0,0 +1,147 @@
+//
+//  FrameCodec.h
+//
+//  A compact format for frame streams.  Positions are
+//    quantized to 16 bits of the world size, velocities to 16
+//    bits of a range chosen at every key frame.  A key frame
+//    puts the particles in Morton order of their positions and
+//    stores the handles and the differences between particles
+//    that follow each other along the curve.  The frames after
+//    it keep that order and store only how far each particle
+//    is from where its last two positions predict it, which is
+//    small for a smooth flow.  The residuals are split into
+//    byte planes and every plane is coded with rANS.
+//
+//  The quantized values are coded without loss, so the only
+//    error is the quantization, which the report measures.  A
+//    new key frame starts when the particle number changes,
+//    when a velocity leaves the range, or every key interval
+//    frames, so a reader can start at any key frame.
+//
+//  Frame_Writer runs the encoder on its thread when it is given
+//    one, Frame_Decoder reads the stream back.
+//
+
+#ifndef __FRAMECODEC_H__
+#define __FRAMECODEC_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "FrameWriter.h"
+
+#define CODEC_MAGIC "SPHCFRM"
+#define CODEC_VERSION 1
+
+struct Codec_File_Header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t fields;				// FIELD_POSITION and FIELD_ID, and FIELD_VELOCITY if chosen
+	float world_x;					// positions are quantized in [0, world]
+	float world_y;
+	int32_t key_interval;
+	int32_t stride;
+};
+
+struct Codec_Frame_Header
+{
+	char tag[4];					// "KEYF" or "DELF"
+	int32_t step;
+	int32_t particles;
+	float velocity_range;			// of the last key frame
+	double time;
+	uint64_t bytes;					// of the coded planes after this header
+};
+
+// quality and size of an encoded stream
+struct Codec_Report
+{
+	long long frames;
+	long long key_frames;
+	long long particles;			// summed over the frames
+	long long raw_bytes;			// of the same fields as floats and ints
+	long long struct_bytes;			// of the frames as arrays of Particle
+	long long coded_bytes;			// headers included
+	double max_position_error;		// in world units
+	double position_error2;			// sum of the squared errors of x and y
+	double max_velocity_error;
+	double velocity_error2;
+
+	void Print(FILE *file) const;
+};
+
+class Frame_Encoder
+{
+public:
+	// velocities are coded if FIELD_VELOCITY is in fields, a key frame at least every key_interval frames
+	Frame_Encoder(Vector2r world, uint32_t fields, int key_interval);
+
+	uint32_t Get_Fields();
+	// the stream header
+	void Encode_Header(int stride, std::vector<unsigned char> &out);
+	// a frame as Frame_Writer fills it, with at least the positions and the ids
+	void Encode(const unsigned char *frame, std::vector<unsigned char> &out);
+	const Codec_Report& Get_Report();
+
+private:
+	Vector2r World;
+	uint32_t Fields;
+	int Key_Interval;
+	int Since_Key;					// frames since the last key frame
+	int History;					// frames of the current order in the history, up to 2
+	float Velocity_Range;
+	std::vector<int32_t> Order;		// handles in the order of the key frame
+	std::vector<int32_t> Slot;		// place of every handle in Order
+	std::vector<int32_t> Last[4];	// quantized x, y, vx, vy of the last frame, in Order
+	std::vector<int32_t> Before[2];	// x and y of the frame before
+	std::vector<int32_t> Current[4];
+	std::vector<uint32_t> Residual;
+	Codec_Report Report;
+};
+
+// a decoded frame, in the order of its key frame
+class Decoded_Frame
+{
+public:
+	int step;
+	double time;
+	bool key;
+	std::vector<float> pos_x;
+	std::vector<float> pos_y;
+	std::vector<float> vel_x;		// empty if the stream has no velocities
+	std::vector<float> vel_y;
+	std::vector<int32_t> id;		// handle of every particle
+};
+
+class Frame_Decoder
+{
+public:
+	Frame_Decoder();
+	~Frame_Decoder();
+
+	// false and a message if the file is not a coded frame stream
+	bool Open(const char *file_name);
+	// the next frame, false at the end or on a damaged frame
+	bool Read(Decoded_Frame &frame);
+	void Close();
+	const Codec_File_Header& Get_Header();
+	// true once Read stopped on a damaged or cut off frame and not at the end of the stream
+	bool Is_Damaged();
+
+private:
+	FILE *File;
+	Codec_File_Header Header;
+	bool Damaged;
+	int History;
+	std::vector<int32_t> Order;
+	std::vector<int32_t> Last[4];
+	std::vector<int32_t> Before[2];
+	std::vector<unsigned char> Buffer;
+	std::vector<uint32_t> Residual;
+
+	Frame_Decoder(const Frame_Decoder&);
+	Frame_Decoder& operator=(const Frame_Decoder&);
+};
+
+#endif
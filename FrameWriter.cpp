@@ -0,0 +1,280 @@
+//
+//  FrameWriter.cpp
+//
+
+#include "FrameWriter.h"
+#include "FrameCodec.h"
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+
+using namespace std;
+
+uint64_t Get_Frame_Bytes(uint32_t fields, int particles){
+	uint64_t per_particle = 0;
+	if(fields & FIELD_POSITION) per_particle += 2 * sizeof(float);
+	if(fields & FIELD_VELOCITY) per_particle += 2 * sizeof(float);
+	if(fields & FIELD_ACCELERATION) per_particle += 2 * sizeof(float);
+	if(fields & FIELD_DENSITY) per_particle += sizeof(float);
+	if(fields & FIELD_PRESSURE) per_particle += sizeof(float);
+	if(fields & FIELD_ID) per_particle += sizeof(int32_t);
+	return per_particle * (uint64_t)particles;
+}
+
+const void* Get_Frame_Field(const unsigned char *frame, uint32_t field, int component){
+	const Frame_Header &h = *(const Frame_Header *)frame;
+	if((h.fields & field) == 0)
+		return NULL;
+	// the fields come in the order of their bits, every one of them as arrays of 4 byte values
+	const unsigned char *p = frame + sizeof(Frame_Header);
+	uint64_t n = (uint64_t)h.particles;
+	for(uint32_t f = 1; f < field; f <<= 1)
+		if(h.fields & f)
+			p += Get_Frame_Bytes(f, h.particles);
+	return p + component * n * 4;
+}
+
+void Frame_Writer_Stats::Print(FILE *file) const{
+	fprintf(file, "frames submitted %lld, written %lld, dropped %lld\n", submitted, written, dropped);
+	fprintf(file, "frames waited for %lld, solver waited %.3f s, writer busy %.3f s, %.3f s of it encoding\n",
+	        waited, wait_seconds, write_seconds, encode_seconds);
+	fprintf(file, "queue mean %.2f, max %d frames, %.1f MB written at %.1f MB/s\n",
+	        submitted > 0 ? queued_sum / submitted : 0.0, max_queued, bytes / 1e6,
+	        write_seconds > 0.0 ? bytes / 1e6 / write_seconds : 0.0);
+}
+
+Frame_Writer::Frame_Writer(){
+	File = NULL;
+	Fields = 0;
+	Stride = 1;
+	Drop_When_Full = false;
+	Failed = false;
+	Encoder = NULL;
+	Frames = NULL;
+	Frame_Number = 0;
+	Free_List = NULL;
+	Free_Count = 0;
+	Queue = NULL;
+	Queue_Head = 0;
+	Queue_Count = 0;
+	Stopping = false;
+	memset(&Stats, 0, sizeof(Stats));
+}
+
+Frame_Writer::~Frame_Writer(){
+	Close();
+}
+
+bool Frame_Writer::Open(const char *file_name, uint32_t fields, int stride, int queue_frames, bool drop_when_full,
+                        Frame_Encoder *encoder){
+	Close();
+	if((fields & FIELD_ALL) == 0){
+		printf("A frame needs at least one field\n");
+		return false;
+	}
+	File = fopen(file_name, "wb");
+	if(File == NULL){
+		printf("Can not write %s\n", file_name);
+		return false;
+	}
+	// the frames are written in large pieces, a large stdio buffer only adds a copy
+	setvbuf(File, NULL, _IONBF, 0);
+
+	Encoder = encoder;
+	Fields = encoder != NULL ? encoder->Get_Fields() : (fields & FIELD_ALL);
+	Stride = max(stride, 1);
+	Drop_When_Full = drop_when_full;
+	Failed = false;
+	Frame_Number = max(queue_frames, 1);
+	Frames = new Frame[Frame_Number];
+	Free_List = new int[Frame_Number];
+	Queue = new int[Frame_Number];
+	for(int i = 0; i < Frame_Number; i++){
+		Frames[i].data = NULL;
+		Frames[i].capacity = 0;
+		Free_List[i] = i;
+	}
+	Free_Count = Frame_Number;
+	Queue_Head = 0;
+	Queue_Count = 0;
+	Stopping = false;
+	memset(&Stats, 0, sizeof(Stats));
+
+	Frame_File_Header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, FRAME_MAGIC, sizeof(FRAME_MAGIC));
+	h.version = FRAME_VERSION;
+	h.byte_order = 0x01020304u;
+	h.fields = Fields;
+	h.stride = Stride;
+	if(Encoder != NULL)
+		Encoder->Encode_Header(Stride, Encoded);
+	else
+		Encoded.assign((const unsigned char *)&h, (const unsigned char *)&h + sizeof(h));
+	if(fwrite(Encoded.data(), 1, Encoded.size(), File) != Encoded.size()){
+		printf("Can not write %s\n", file_name);
+		fclose(File);
+		File = NULL;
+		return false;
+	}
+
+	Writer = thread(&Frame_Writer::Writer_Loop, this);
+	return true;
+}
+
+bool Frame_Writer::Is_Open(){
+	return File != NULL;
+}
+
+// positions and the other fields as floats, one array per coordinate
+void Frame_Writer::Fill(Frame &f, SPH &sph){
+	const Particle_Arrays *p = sph.Get_Particle_Arrays();
+	int n = sph.Get_Particle_Number();
+	uint64_t bytes = sizeof(Frame_Header) + Get_Frame_Bytes(Fields, n);
+	if(bytes > f.capacity){
+		f.capacity = bytes + bytes / 4;			// room for some more particles
+		Aligned_Free(f.data);
+		f.data = (unsigned char *)Aligned_Malloc((size_t)f.capacity);
+	}
+
+	Frame_Header h;
+	memcpy(h.tag, "FRAM", 4);
+	h.fields = Fields;
+	h.step = sph.Get_Step_Count();
+	h.particles = n;
+	h.time = sph.Get_Simulation_Time();
+	h.bytes = bytes - sizeof(Frame_Header);
+	memcpy(f.data, &h, sizeof(h));
+
+	float *out = (float *)(f.data + sizeof(Frame_Header));
+	const Real *arrays[8] = {p->pos_x, p->pos_y, p->vel_x, p->vel_y, p->acc_x, p->acc_y, p->dens, p->pres};
+	const uint32_t owner[8] = {FIELD_POSITION, FIELD_POSITION, FIELD_VELOCITY, FIELD_VELOCITY,
+	                           FIELD_ACCELERATION, FIELD_ACCELERATION, FIELD_DENSITY, FIELD_PRESSURE};
+	for(int a = 0; a < 8; a++){
+		if((Fields & owner[a]) == 0)
+			continue;
+		const Real *src = arrays[a];
+		for(int i = 0; i < n; i++)
+			out[i] = (float)src[i];
+		out += n;
+	}
+	if(Fields & FIELD_ID)
+		memcpy(out, p->id, sizeof(int32_t) * n);
+}
+
+bool Frame_Writer::Submit(SPH &sph){
+	if(File == NULL)
+		return false;
+	if(sph.Get_Step_Count() % Stride != 0)
+		return false;
+
+	int index;
+	{
+		unique_lock<mutex> guard(Lock);
+		Stats.submitted++;
+		Stats.queued_sum += Queue_Count;
+		if(Failed||((Free_Count == 0)&&Drop_When_Full)){
+			Stats.dropped++;
+			return false;
+		}
+		if(Free_Count == 0){
+			// the disk is behind, the solver waits for the writer
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			Frame_Freed.wait(guard, [this]{ return Free_Count > 0; });
+			Stats.waited++;
+			Stats.wait_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		}
+		index = Free_List[--Free_Count];
+	}
+
+	// the copy is made without the lock, the writer only touches queued frames
+	Fill(Frames[index], sph);
+
+	{
+		lock_guard<mutex> guard(Lock);
+		Queue[(Queue_Head + Queue_Count) % Frame_Number] = index;
+		Queue_Count++;
+		Stats.max_queued = max(Stats.max_queued, Queue_Count);
+	}
+	Frame_Queued.notify_one();
+	return true;
+}
+
+void Frame_Writer::Writer_Loop(){
+	for(;;){
+		int index;
+		{
+			unique_lock<mutex> guard(Lock);
+			Frame_Queued.wait(guard, [this]{ return (Queue_Count > 0)||Stopping; });
+			if(Queue_Count == 0)
+				return;				// stopping and nothing left
+			index = Queue[Queue_Head];
+		}
+
+		// the frame stays at the head of the queue while it is written, so it counts as queued
+		Frame &f = Frames[index];
+		const unsigned char *data = f.data;
+		uint64_t bytes = sizeof(Frame_Header) + ((Frame_Header *)f.data)->bytes;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		double encode_seconds = 0.0;
+		if(Encoder != NULL){
+			Encoder->Encode(f.data, Encoded);
+			data = Encoded.data();
+			bytes = Encoded.size();
+			encode_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		}
+		bool ok = fwrite(data, 1, (size_t)bytes, File) == bytes;
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		{
+			lock_guard<mutex> guard(Lock);
+			Queue_Head = (Queue_Head + 1) % Frame_Number;
+			Queue_Count--;
+			Free_List[Free_Count++] = index;
+			Stats.write_seconds += seconds;
+			Stats.encode_seconds += encode_seconds;
+			if(ok){
+				Stats.written++;
+				Stats.bytes += bytes;
+			}
+			else{
+				Stats.dropped++;
+				Failed = true;
+			}
+		}
+		Frame_Freed.notify_one();
+	}
+}
+
+bool Frame_Writer::Close(){
+	if(File == NULL)
+		return true;
+	{
+		lock_guard<mutex> guard(Lock);
+		Stopping = true;
+	}
+	Frame_Queued.notify_one();
+	Writer.join();
+
+	bool ok = !Failed;
+	if(fclose(File) != 0)
+		ok = false;
+	if(!ok)
+		printf("Writing the frames failed, %lld frames were lost\n", Stats.dropped);
+	File = NULL;
+	for(int i = 0; i < Frame_Number; i++)
+		Aligned_Free(Frames[i].data);
+	delete[] Frames;
+	delete[] Free_List;
+	delete[] Queue;
+	Frames = NULL;
+	Free_List = NULL;
+	Queue = NULL;
+	Frame_Number = 0;
+	return ok;
+}
+
+Frame_Writer_Stats Frame_Writer::Get_Stats(){
+	lock_guard<mutex> guard(Lock);
+	return Stats;
+}
@@ -0,0 +1,145 @@
+//
+//  FrameWriter.h
+//
+//  Writes frames of the simulation to a binary stream on a
+//    background thread, so the solver never waits for the
+//    disk while the disk keeps up.  Submit copies the chosen
+//    fields of the particles into a free frame of a fixed pool
+//    and queues it; the writer thread writes queued frames in
+//    order and returns them to the pool.  When all frames are
+//    queued, Submit waits for the writer or drops the frame,
+//    and the statistics show how often and how long, which
+//    tells whether the disk is the bottleneck.
+//
+//  The stream is a File_Header followed by one chunk per
+//    frame: a Frame_Header and then the chosen fields in the
+//    order of Frame_Field, each as one array of all particles,
+//    x and y of a vector as two arrays.  Values are 32 bit
+//    floats and ids 32 bit ints, whatever Real is.  With a
+//    Frame_Encoder the stream is in the compact format of
+//    FrameCodec.h instead.
+//
+
+#ifndef __FRAMEWRITER_H__
+#define __FRAMEWRITER_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include "SPH.h"
+
+class Frame_Encoder;
+
+// fields of a frame, combined with |
+enum Frame_Field{
+	FIELD_POSITION = 1,
+	FIELD_VELOCITY = 2,
+	FIELD_ACCELERATION = 4,
+	FIELD_DENSITY = 8,
+	FIELD_PRESSURE = 16,
+	FIELD_ID = 32,					// handle of every particle, to follow it when the particles are sorted
+	FIELD_ALL = 63
+};
+
+#define FRAME_MAGIC "SPHFRMS"
+#define FRAME_VERSION 1
+
+struct Frame_File_Header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;			// 0x01020304 as written
+	uint32_t fields;
+	int32_t stride;					// steps between frames
+};
+
+struct Frame_Header
+{
+	char tag[4];					// "FRAM"
+	uint32_t fields;
+	int32_t step;
+	int32_t particles;
+	double time;					// simulated seconds
+	uint64_t bytes;					// of the arrays after this header
+};
+
+// bytes of the arrays of a frame
+uint64_t Get_Frame_Bytes(uint32_t fields, int particles);
+// array of one field of a frame that starts with a Frame_Header, component 1 is y, NULL if it is not there
+const void* Get_Frame_Field(const unsigned char *frame, uint32_t field, int component);
+
+// counters of a Frame_Writer, waits are on the solver thread, writes on the writer thread
+struct Frame_Writer_Stats
+{
+	long long submitted;			// frames handed to Submit on a stride step
+	long long written;
+	long long dropped;				// not written because the queue was full or the disk failed
+	long long waited;				// frames Submit had to wait for
+	double wait_seconds;			// time the solver spent waiting for a free frame
+	double write_seconds;			// time the writer spent in fwrite
+	double encode_seconds;			// part of write_seconds spent in the encoder
+	long long bytes;
+	int max_queued;					// most frames in the queue at once
+	double queued_sum;				// frames in the queue at every submit, for the mean
+
+	void Print(FILE *file) const;
+};
+
+class Frame_Writer
+{
+public:
+	Frame_Writer();
+	~Frame_Writer();
+
+	// start writing to file_name, queue_frames is the pool size, false and a message if it fails,
+	// with an encoder the frames are coded on the writer thread and the fields are the ones it codes
+	bool Open(const char *file_name, uint32_t fields, int stride, int queue_frames, bool drop_when_full,
+	          Frame_Encoder *encoder = NULL);
+	// queue the state of sph if its step is a multiple of the stride, false if it was not queued
+	bool Submit(SPH &sph);
+	// write what is queued and stop the thread, false if a write failed
+	bool Close();
+	bool Is_Open();
+	Frame_Writer_Stats Get_Stats();
+
+private:
+	struct Frame
+	{
+		unsigned char *data;		// Frame_Header and the arrays, written with one fwrite
+		uint64_t capacity;
+	};
+
+	FILE *File;
+	uint32_t Fields;
+	int Stride;
+	bool Drop_When_Full;
+	bool Failed;					// a write failed, later frames are dropped
+	Frame_Encoder *Encoder;			// NULL to write the frames as they are
+	std::vector<unsigned char> Encoded;
+
+	Frame *Frames;
+	int Frame_Number;
+	int *Free_List;					// frames Submit may fill
+	int Free_Count;
+	int *Queue;						// frames waiting for the writer, a ring
+	int Queue_Head;
+	int Queue_Count;
+	bool Stopping;
+
+	std::thread Writer;
+	std::mutex Lock;				// guards the lists, Stats and Failed
+	std::condition_variable Frame_Queued;
+	std::condition_variable Frame_Freed;
+	Frame_Writer_Stats Stats;
+
+	void Writer_Loop();
+	void Fill(Frame &f, SPH &sph);
+
+	Frame_Writer(const Frame_Writer&);
+	Frame_Writer& operator=(const Frame_Writer&);
+};
+
+#endif
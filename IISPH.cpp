@@ -0,0 +1,181 @@
+//
+//  IISPH.cpp
+//
+//  Implicit incompressible SPH (Ihmsen et al. 2014).  Instead
+//    of the Tait equation, the pressure is the solution of a
+//    pressure Poisson equation that makes the density after
+//    the step equal to the rest density.  The equation is
+//    solved with relaxed Jacobi iterations until the mean
+//    compression is below the tolerance.  Because the
+//    pressure does not depend on a stiffness, the time step is
+//    only limited by the particle speed, so it can be much
+//    larger than for the weakly compressible solver.
+//
+//  The pairs come from the same grid or neighbor list as the
+//    other passes and are stored once per step with their
+//    kernel gradients, since every iteration visits them
+//    twice.  Pressures are clamped to 0 or more, so the free
+//    surface does not pull particles together.
+//
+//  The walls enter like neighbors at rest that feel no
+//    pressure (Akinci et al. 2012): the gradient of the wall
+//    density from the density pass is the sum of their kernel
+//    gradients, already weighted by their mass.
+//
+
+#include "SPH.h"
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+#define IISPH_RELAXATION 0.5f		// weight of the Jacobi update
+
+void SPH::Solve_IISPH(){
+	Solver_Arrays &s = Solver_Data;
+	Particle_Arrays &p = Particles;
+	int n = Number_Particles;
+
+	// the last pressures make a good start, the Tait pressures of the density pass do not
+	#pragma omp parallel for num_threads(Number_Threads)
+	for(int i = 0; i < n; i++)
+		s.pres[i] = 0.5f * p.pres[i];
+
+	// density, then the acceleration without pressure: viscosity and gravity
+	Comupte_Density_SingPressure();
+	#pragma omp parallel for num_threads(Number_Threads)
+	for(int i = 0; i < n; i++)
+		p.pres[i] = 0.0f;
+	Computer_Force();
+	if(Adaptive_Time)
+		Time_Delta = Compute_Time_Delta(false);
+
+	PROFILE_SCOPE(Timing, PHASE_PRESSURE);
+	Build_Solver_Pairs();
+	const int *index = Pair_Index;
+	const Real *grad_x = Pair_Grad_x;
+	const Real *grad_y = Pair_Grad_y;
+	const Real dt = Time_Delta;
+	const Real dt2 = dt * dt;
+	const Real m = mass;
+	const Real rest = Stand_Density;
+	const bool walls = Use_Boundary;
+
+	// velocity after the other forces
+	#pragma omp parallel for num_threads(Number_Threads)
+	for(int i = 0; i < n; i++){
+		s.vel_x[i] = p.vel_x[i] + dt * p.acc_x[i];
+		s.vel_y[i] = p.vel_y[i] + dt * p.acc_y[i];
+	}
+
+	// d_ii, the displacement of i by its own pressure, and the density after the other forces
+	#pragma omp parallel for num_threads(Number_Threads) schedule(dynamic, 256)
+	for(int i = 0; i < n; i++){
+		Real gx = 0.0f;
+		Real gy = 0.0f;
+		Real change = 0.0f;
+		for(int k = Pair_Start[i]; k < Pair_Start[i + 1]; k++){
+			int j = index[k];
+			gx += grad_x[k];
+			gy += grad_y[k];
+			change += (s.vel_x[i] - s.vel_x[j]) * grad_x[k] + (s.vel_y[i] - s.vel_y[j]) * grad_y[k];
+		}
+		Real rho = p.dens[i];
+		Real bx = walls ? Boundary_Grad_x[i] : 0.0f;
+		Real by = walls ? Boundary_Grad_y[i] : 0.0f;
+		s.d_x[i] = -dt2 / (rho * rho) * (m * gx + bx);
+		s.d_y[i] = -dt2 / (rho * rho) * (m * gy + by);
+		s.dens[i] = rho + dt * (m * change + s.vel_x[i] * bx + s.vel_y[i] * by);
+	}
+
+	// a_ii, the diagonal, how the density of i reacts to its own pressure
+	#pragma omp parallel for num_threads(Number_Threads) schedule(dynamic, 256)
+	for(int i = 0; i < n; i++){
+		Real rho = p.dens[i];
+		Real c = dt2 * m / (rho * rho);		// d_ji = c * grad W_ij
+		Real a = 0.0f;
+		for(int k = Pair_Start[i]; k < Pair_Start[i + 1]; k++)
+			a += m * ((s.d_x[i] - c * grad_x[k]) * grad_x[k] + (s.d_y[i] - c * grad_y[k]) * grad_y[k]);
+		if(walls)
+			a += s.d_x[i] * Boundary_Grad_x[i] + s.d_y[i] * Boundary_Grad_y[i];
+		s.diag[i] = a;
+	}
+
+	int iterations = 0;
+	Real error = 0.0f;
+	do{
+		// sum over j of d_ij p_j, the displacement of i by the pressure of its neighbors
+		#pragma omp parallel for num_threads(Number_Threads) schedule(dynamic, 256)
+		for(int i = 0; i < n; i++){
+			Real sx = 0.0f;
+			Real sy = 0.0f;
+			for(int k = Pair_Start[i]; k < Pair_Start[i + 1]; k++){
+				int j = index[k];
+				Real rho = p.dens[j];
+				Real g = -dt2 * m / (rho * rho) * s.pres[j];
+				sx += g * grad_x[k];
+				sy += g * grad_y[k];
+			}
+			s.sum_x[i] = sx;
+			s.sum_y[i] = sy;
+		}
+
+		// Jacobi update, and the compression the current pressures would leave
+		double compression = 0.0;
+		#pragma omp parallel for num_threads(Number_Threads) schedule(dynamic, 256) reduction(+:compression)
+		for(int i = 0; i < n; i++){
+			Real rho = p.dens[i];
+			Real c = dt2 * m / (rho * rho);
+			Real pi = s.pres[i];
+			Real sum = 0.0f;
+			for(int k = Pair_Start[i]; k < Pair_Start[i + 1]; k++){
+				int j = index[k];
+				Real gx = grad_x[k];
+				Real gy = grad_y[k];
+				// displacement of i by the others minus that of j by everyone but i
+				Real ex = s.sum_x[i] - s.d_x[j] * s.pres[j] - (s.sum_x[j] - c * gx * pi);
+				Real ey = s.sum_y[i] - s.d_y[j] * s.pres[j] - (s.sum_y[j] - c * gy * pi);
+				sum += m * (ex * gx + ey * gy);
+			}
+			if(walls)
+				sum += s.sum_x[i] * Boundary_Grad_x[i] + s.sum_y[i] * Boundary_Grad_y[i];
+			Real a = s.diag[i];
+			Real predicted = s.dens[i] + a * pi + sum;
+			Real next = 0.0f;
+			if(fabs(a) > INF)
+				next = (1.0f - IISPH_RELAXATION) * pi + IISPH_RELAXATION * (rest - s.dens[i] - sum) / a;
+			s.pres_new[i] = max(next, (Real)0.0f);
+			compression += max(predicted - rest, (Real)0.0f);
+		}
+		swap(s.pres, s.pres_new);
+		iterations++;
+		error = n > 0 ? (Real)(compression / n / rest) : 0.0f;
+	}while((iterations < Min_Solver_Iterations)||((iterations < Max_Solver_Iterations)&&(error > Solver_Tolerance)));
+
+	Solver_Iterations = iterations;
+	Total_Solver_Iterations += iterations;
+	Density_Error = error;
+
+	// add the pressure acceleration and keep the pressures for the next step and the display
+	#pragma omp parallel for num_threads(Number_Threads) schedule(dynamic, 256)
+	for(int i = 0; i < n; i++){
+		Real rho = p.dens[i];
+		Real own = s.pres[i] / (rho * rho);
+		Real ax = 0.0f;
+		Real ay = 0.0f;
+		for(int k = Pair_Start[i]; k < Pair_Start[i + 1]; k++){
+			int j = index[k];
+			Real rj = p.dens[j];
+			Real g = m * (own + s.pres[j] / (rj * rj));
+			ax -= g * grad_x[k];
+			ay -= g * grad_y[k];
+		}
+		if(walls){
+			ax -= own * Boundary_Grad_x[i];
+			ay -= own * Boundary_Grad_y[i];
+		}
+		p.acc_x[i] += ax;
+		p.acc_y[i] += ay;
+		p.pres[i] = s.pres[i];
+	}
+}
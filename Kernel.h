@@ -0,0 +1,65 @@
+//
+//  Kernel.h
+//
+//  The smoothing kernels of Muller et al. and the Tait equation
+//    of state, written with integer powers expanded at compile
+//    time by ipow instead of calls to pow.
+//
+
+#ifndef __KERNEL_H__
+#define __KERNEL_H__
+
+#include "DataStructure.h"
+
+#define PI 3.141592f
+
+// x to the power N by repeated squaring, fully expanded at compile time
+template<int N, class T>
+inline constexpr T ipow(T x){
+	return N == 0 ? T(1) : (N % 2 ? x : T(1)) * ipow<N / 2>(x * x);
+}
+
+// constants of the kernel functions, computed once for a kernel size h
+class Kernel_Constants
+{
+public:
+	Real kernel;		// h
+	Real kernel2;		// h^2
+	Real kernel6;		// h^6
+	Real mass;
+	Real poly6;			// 315 / (64 pi h^9)
+	Real spiky;			// 45 / (pi h^6)
+	Real viscosity;		// Viscosity_Constant
+
+	void Set(Real h, Real particle_mass, Real viscosity_constant){
+		kernel = h;
+		kernel2 = h * h;
+		kernel6 = ipow<3>(kernel2);
+		mass = particle_mass;
+		poly6 = 315.0f / (64.0f * PI * kernel6 * ipow<3>(h));
+		spiky = 45.0f / (PI * kernel6);
+		viscosity = viscosity_constant;
+	}
+};
+
+// for density, r2 is the squared distance
+inline Real Kernel_Poly6(const Kernel_Constants &c, Real r2){
+	return c.poly6 * ipow<3>(c.kernel2 - r2);
+}
+
+// for pressure
+inline Real Kernel_Spiky(const Kernel_Constants &c, Real r){
+	return -c.spiky * ipow<2>(c.kernel - r);
+}
+
+// for viscosity
+inline Real Kernel_Visco(const Kernel_Constants &c, Real r){
+	return c.spiky * (c.kernel - r);
+}
+
+// Tait equation of state with exponent 7
+inline Real Tait_Pressure(Real dens, Real rest_density, Real k){
+	return (ipow<7>(dens / rest_density) - 1) * k;
+}
+
+#endif
@@ -3,9 +3,16 @@
 //
 
 #include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include "ParticleRenderer.h"		// before GetGlut.h, it declares the buffer functions
 #include "GetGlut.h"
 #include "DataStructure.h"
 #include "SPH.h"
+#include "Snapshot.h"
+#include "TripleBuffer.h"
 
 using namespace std;
 
@@ -15,12 +22,27 @@ void keyboard(unsigned char key, int x, int y);
 void update();
 void reshape(int w, int h);
 void display();
+void startSimulation();
+void stopSimulation();
 
 //declare global variables here
 SPH sph;
 int winX = 600;
 int winY = 600;
 
+// the simulation runs on its own thread and publishes the positions after every few steps,
+// the display draws the newest published positions, so neither waits for the other
+Triple_Buffer<Particle_Snapshot> snapshots;
+thread simThread;
+atomic<bool> simRunning(false);
+atomic<int> substeps(1);		// steps between snapshots, + and - change it
+atomic<int> colorValue(VALUE_NONE);	// Snapshot_Value the particles are colored by, c changes it
+Particle_Renderer renderer;
+
+// step rate shown in the title
+int titleTime = 0;
+int titleStep = 0;
+
 int main (int argc, char** argv)
 {
 	glutInitWindowSize(winX, winY);
@@ -35,6 +57,9 @@ int main (int argc, char** argv)
 	glutDisplayFunc(display);
 
 	initDisplay();
+	startSimulation();
+	// closing the window makes GLUT call exit, the thread must stop before the globals are destroyed
+	atexit(stopSimulation);
 
 	glutMainLoop();
 
@@ -52,19 +77,62 @@ void initDisplay()
 	glHint(GL_POINT_SMOOTH_HINT, GL_NICEST);
 	
 	glClearColor(1.0f, 1.0f, 1.0f, 1.0);
+
+	if(!renderer.Init())
+		printf("No vertex buffers, the particles are drawn from client memory\n");
+}
+
+void simulationLoop()
+{
+	while(simRunning.load(memory_order_relaxed))
+	{
+		int n = substeps.load(memory_order_relaxed);
+		for(int i = 0; i < n; i++)
+			sph.Animation();
+		snapshots.Get_Back().Capture(sph, (Snapshot_Value)colorValue.load(memory_order_relaxed));
+		snapshots.Publish();
+	}
+}
+
+void startSimulation()
+{
+	simRunning = true;
+	simThread = thread(simulationLoop);
+}
+
+void stopSimulation()
+{
+	simRunning = false;
+	if(simThread.joinable())
+		simThread.join();
 }
 
 void DrawParticles(){
-	Particle *p = sph.Get_Paticles();
-	glColor3f(1.0f, 0.0f, 1.0f);
+	snapshots.Update();
+	const Particle_Snapshot &p = snapshots.Get_Front();
 	glPointSize(5.0f);
+	renderer.Draw(p);
+}
 
-	glBegin(GL_POINTS);
-	for(int i=0; i<sph.Get_Particle_Number(); i++)
-		{
-			glVertex2f(p[i].pos.x, p[i].pos.y);
-		}
-	glEnd();
+// steps per second, substeps, drawing times and the color range in the window title, once a second
+void updateTitle()
+{
+	int time = glutGet(GLUT_ELAPSED_TIME);
+	if(time - titleTime < 1000)
+		return;
+	const Particle_Snapshot &p = snapshots.Get_Front();
+	int step = p.step;
+	double upload_ms, draw_ms;
+	renderer.Take_Times(upload_ms, draw_ms);
+	char range[64] = "";
+	if(p.kind != VALUE_NONE)
+		snprintf(range, sizeof(range), ", %s %.4g to %.4g", p.kind == VALUE_DENSITY ? "density" : "pressure", p.low, p.high);
+	char title[256];
+	snprintf(title, sizeof(title), "SPH Fluid 2D BINGYANG LIU - %.0f steps/s, %d substeps, upload %.2f ms, draw %.2f ms%s",
+	         (step - titleStep) * 1000.0 / (time - titleTime), substeps.load(), upload_ms, draw_ms, range);
+	glutSetWindowTitle(title);
+	titleTime = time;
+	titleStep = step;
 }
 
 void keyboard(unsigned char key, int x, int y)
@@ -72,8 +140,21 @@ void keyboard(unsigned char key, int x, int y)
 	switch (key)
 	{
 	case 27: // on [ESC]
+		stopSimulation();
+		renderer.Release();
 		exit(0); // normal exit
 		break;
+	case '+':
+	case '=':
+		substeps++;
+		break;
+	case '-':
+		if(substeps > 1)
+			substeps--;
+		break;
+	case 'c':
+		colorValue = (colorValue + 1) % VALUE_COUNT;
+		break;
 	}
 }
 
@@ -93,10 +174,10 @@ void reshape(int w, int h)
 
 void display (void)
 {
-	sph.Animation();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	// clear the screen - any drawing before here will not display
 	DrawParticles();
+	updateTitle();
 	// send the current image to the screen - any drawing after here will not display
 	glutSwapBuffers();
 
@@ -0,0 +1,239 @@
+//
+//  Obstacle.cpp
+//
+
+#include "Obstacle.h"
+#include "ObjLibrary/ObjModel.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+#define TREE_LEAF 4				// items per leaf
+#define TREE_STACK 64			// deeper than any tree of median splits
+
+void Box_Tree::Build(const vector<Vector2r> &low, const vector<Vector2r> &high){
+	int n = (int)low.size();
+	nodes.clear();
+	items.resize(n);
+	vector<Vector2r> center(n);
+	for(int i = 0; i < n; i++){
+		items[i] = i;
+		center[i] = (low[i] + high[i]) * 0.5f;
+	}
+	Build_Node(low, high, center, 0, n);
+}
+
+// node over items[begin, end), split at the median of the centers along the longer side
+int Box_Tree::Build_Node(const vector<Vector2r> &low, const vector<Vector2r> &high,
+                         vector<Vector2r> &center, int begin, int end){
+	int index = (int)nodes.size();
+	nodes.push_back(Node());
+	Vector2r box_low(1e30f, 1e30f), box_high(-1e30f, -1e30f);
+	for(int k = begin; k < end; k++){
+		int i = items[k];
+		box_low = Vector2r(min(box_low.x, low[i].x), min(box_low.y, low[i].y));
+		box_high = Vector2r(max(box_high.x, high[i].x), max(box_high.y, high[i].y));
+	}
+	nodes[index].low = box_low;
+	nodes[index].high = box_high;
+	if(end - begin <= TREE_LEAF){
+		nodes[index].first = begin;
+		nodes[index].count = end - begin;
+		return index;
+	}
+	bool along_x = box_high.x - box_low.x >= box_high.y - box_low.y;
+	int middle = (begin + end) / 2;
+	nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end, [&](int a, int b){
+		return along_x ? center[a].x < center[b].x : center[a].y < center[b].y;
+	});
+	// the first child comes right after its parent, the second one after the whole first subtree
+	Build_Node(low, high, center, begin, middle);
+	int second = Build_Node(low, high, center, middle, end);		// nodes may move, so no reference is held
+	nodes[index].first = second;
+	nodes[index].count = 0;
+	return index;
+}
+
+Obstacle::Obstacle(){
+	Polygon_Start.push_back(0);
+	Low = Vector2r(0.0f, 0.0f);
+	High = Vector2r(0.0f, 0.0f);
+}
+
+bool Obstacle::Load_OBJ(const char *file_name, Real scale, Vector2r offset){
+	ObjModel model;
+	model.load(file_name);			// reports a missing file itself
+	if(model.getFaceCountTotal() == 0){
+		printf("%s has no faces\n", file_name);
+		return false;
+	}
+	for(unsigned int s = 0; s < model.getFaceSetCount(); s++)
+		for(unsigned int f = 0; f < model.getFaceCount(s); f++){
+			unsigned int corners = model.getFaceVertexCount(s, f);
+			for(unsigned int v = 0; v < corners; v++){
+				unsigned int vertex = model.getFaceVertexIndex(s, f, v);
+				Corners.push_back(Vector2r((Real)model.getVertexX(vertex), (Real)model.getVertexY(vertex)) * scale + offset);
+			}
+			Polygon_Start.push_back((int)Corners.size());
+		}
+	Build();
+	printf("%s: %d polygons, %d outline edges\n", file_name, Get_Polygon_Number(), Get_Edge_Number());
+	return true;
+}
+
+void Obstacle::Add_Polygon(const vector<Vector2r> &corners){
+	Corners.insert(Corners.end(), corners.begin(), corners.end());
+	Polygon_Start.push_back((int)Corners.size());
+	Build();
+}
+
+void Obstacle::Build(){
+	int polygons = Get_Polygon_Number();
+	vector<Vector2r> low(polygons), high(polygons);
+	Low = Vector2r(1e30f, 1e30f);
+	High = Vector2r(-1e30f, -1e30f);
+	for(int p = 0; p < polygons; p++){
+		low[p] = Vector2r(1e30f, 1e30f);
+		high[p] = Vector2r(-1e30f, -1e30f);
+		for(int c = Polygon_Start[p]; c < Polygon_Start[p + 1]; c++){
+			low[p] = Vector2r(min(low[p].x, Corners[c].x), min(low[p].y, Corners[c].y));
+			high[p] = Vector2r(max(high[p].x, Corners[c].x), max(high[p].y, Corners[c].y));
+		}
+		Low = Vector2r(min(Low.x, low[p].x), min(Low.y, low[p].y));
+		High = Vector2r(max(High.x, high[p].x), max(High.y, high[p].y));
+	}
+	Polygon_Tree.Build(low, high);
+
+	// an edge is on the outline if the solid is on one side of its midpoint only
+	Real size = max(High.x - Low.x, High.y - Low.y);
+	Edge_A.clear();
+	Edge_B.clear();
+	for(int p = 0; p < polygons; p++){
+		int first = Polygon_Start[p];
+		int corners = Polygon_Start[p + 1] - first;
+		for(int c = 0; c < corners; c++){
+			Vector2r a = Corners[first + c];
+			Vector2r b = Corners[first + (c + 1) % corners];
+			Vector2r d = b - a;
+			Real length = sqrt(d.x * d.x + d.y * d.y);
+			if(length <= size * 1e-6f)
+				continue;
+			Vector2r side = Vector2r(-d.y, d.x) * (size * 1e-4f / length);
+			Vector2r middle = (a + b) * 0.5f;
+			if(Inside(middle + side) != Inside(middle - side)){
+				Edge_A.push_back(a);
+				Edge_B.push_back(b);
+			}
+		}
+	}
+	int edges = (int)Edge_A.size();
+	low.resize(edges);
+	high.resize(edges);
+	for(int e = 0; e < edges; e++){
+		low[e] = Vector2r(min(Edge_A[e].x, Edge_B[e].x), min(Edge_A[e].y, Edge_B[e].y));
+		high[e] = Vector2r(max(Edge_A[e].x, Edge_B[e].x), max(Edge_A[e].y, Edge_B[e].y));
+	}
+	Edge_Tree.Build(low, high);
+}
+
+// even-odd rule, a ray along x counts the edges it crosses
+bool Obstacle::Inside_Polygon(int polygon, Vector2r p) const{
+	int first = Polygon_Start[polygon];
+	int corners = Polygon_Start[polygon + 1] - first;
+	bool inside = false;
+	for(int c = 0, last = corners - 1; c < corners; last = c++){
+		Vector2r a = Corners[first + c];
+		Vector2r b = Corners[first + last];
+		if(((a.y > p.y) != (b.y > p.y))&&(p.x < a.x + (b.x - a.x) * (p.y - a.y) / (b.y - a.y)))
+			inside = !inside;
+	}
+	return inside;
+}
+
+bool Obstacle::Inside(Vector2r p) const{
+	if(Polygon_Tree.nodes.empty())
+		return false;
+	int stack[TREE_STACK];
+	int top = 0;
+	stack[top++] = 0;
+	while(top > 0){
+		int i = stack[--top];
+		const Box_Tree::Node &n = Polygon_Tree.nodes[i];
+		if((p.x < n.low.x)||(p.x > n.high.x)||(p.y < n.low.y)||(p.y > n.high.y))
+			continue;
+		if(n.count == 0){
+			stack[top++] = i + 1;
+			stack[top++] = n.first;
+			continue;
+		}
+		for(int k = n.first; k < n.first + n.count; k++)
+			if(Inside_Polygon(Polygon_Tree.items[k], p))
+				return true;
+	}
+	return false;
+}
+
+// squared distance from p to a box, 0 inside it
+static inline Real Box_Distance2(const Box_Tree::Node &n, Vector2r p){
+	Real dx = max(max(n.low.x - p.x, p.x - n.high.x), (Real)0.0f);
+	Real dy = max(max(n.low.y - p.y, p.y - n.high.y), (Real)0.0f);
+	return dx * dx + dy * dy;
+}
+
+Real Obstacle::Edge_Distance2(Vector2r p) const{
+	Real best = 1e30f;
+	if(Edge_Tree.nodes.empty())
+		return best;
+	int stack[TREE_STACK];
+	int top = 0;
+	stack[top++] = 0;
+	while(top > 0){
+		int i = stack[--top];
+		const Box_Tree::Node &n = Edge_Tree.nodes[i];
+		if(Box_Distance2(n, p) >= best)
+			continue;
+		if(n.count == 0){
+			// the nearer child goes on top, so it is searched first and prunes the other one
+			int a = i + 1;
+			int b = n.first;
+			if(Box_Distance2(Edge_Tree.nodes[a], p) < Box_Distance2(Edge_Tree.nodes[b], p))
+				swap(a, b);
+			stack[top++] = a;
+			stack[top++] = b;
+			continue;
+		}
+		for(int k = n.first; k < n.first + n.count; k++){
+			int e = Edge_Tree.items[k];
+			Vector2r d = Edge_B[e] - Edge_A[e];
+			Vector2r w = p - Edge_A[e];
+			Real t = min(max((w.x * d.x + w.y * d.y) / (d.x * d.x + d.y * d.y), (Real)0.0f), (Real)1.0f);
+			Real x = w.x - t * d.x;
+			Real y = w.y - t * d.y;
+			best = min(best, x * x + y * y);
+		}
+	}
+	return best;
+}
+
+Real Obstacle::Distance(Vector2r p) const{
+	Real d = sqrt(Edge_Distance2(p));
+	return Inside(p) ? -d : d;
+}
+
+int Obstacle::Get_Polygon_Number() const{
+	return (int)Polygon_Start.size() - 1;
+}
+
+int Obstacle::Get_Edge_Number() const{
+	return (int)Edge_A.size();
+}
+
+Vector2r Obstacle::Get_Low() const{
+	return Low;
+}
+
+Vector2r Obstacle::Get_High() const{
+	return High;
+}
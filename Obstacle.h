@@ -0,0 +1,84 @@
+//
+//  Obstacle.h
+//
+//  A solid shape in the simulation plane, made of polygons,
+//    for example the faces of an OBJ file of the ObjLibrary
+//    projected onto the x y plane.  The solid is the union of
+//    the polygons, so a flat model and a model extruded along
+//    z both give their outline.  A polygon may be concave, a
+//    point is inside it by the even-odd rule.
+//
+//  The outline is the polygon edges with the solid on one side
+//    only, the edges between two faces of a mesh are dropped.
+//    An edge is kept or dropped whole, by the sides of its
+//    midpoint.  The signed distance is the distance to the
+//    nearest outline edge, negative inside.
+//
+//  Both queries go through a bounding volume hierarchy, one
+//    over the polygons and one over the outline edges, so they
+//    take about log n steps for n edges.  They are meant for
+//    baking a Distance_Field, the solver then samples the field
+//    and never looks at the polygons.
+//
+
+#ifndef __OBSTACLE_H__
+#define __OBSTACLE_H__
+
+#include <vector>
+#include "DataStructure.h"
+
+// a bounding volume hierarchy of axis aligned boxes, every leaf holds a few items
+class Box_Tree
+{
+public:
+	class Node
+	{
+	public:
+		Vector2r low, high;
+		int first;			// first item of a leaf, or the second child, the first one is the next node
+		int count;			// items of a leaf, 0 for an inner node
+	};
+	std::vector<Node> nodes;			// the root is node 0
+	std::vector<int> items;				// item numbers in leaf order
+
+	// tree over the boxes low[i] to high[i]
+	void Build(const std::vector<Vector2r> &low, const std::vector<Vector2r> &high);
+
+private:
+	int Build_Node(const std::vector<Vector2r> &low, const std::vector<Vector2r> &high,
+	               std::vector<Vector2r> &center, int begin, int end);
+};
+
+class Obstacle
+{
+public:
+	Obstacle();
+
+	// the faces of an OBJ file projected onto the x y plane, scaled by scale and moved by
+	// offset, added to the polygons, false and a message if the file has no faces
+	bool Load_OBJ(const char *file_name, Real scale, Vector2r offset);
+	void Add_Polygon(const std::vector<Vector2r> &corners);
+
+	bool Inside(Vector2r p) const;
+	Real Distance(Vector2r p) const;		// signed, negative inside
+
+	int Get_Polygon_Number() const;
+	int Get_Edge_Number() const;			// of the outline
+	Vector2r Get_Low() const;				// bounding box of the polygons
+	Vector2r Get_High() const;
+
+private:
+	std::vector<Vector2r> Corners;			// of all polygons, one after the other
+	std::vector<int> Polygon_Start;			// first corner of every polygon, one more entry at the end
+	std::vector<Vector2r> Edge_A;			// outline edges
+	std::vector<Vector2r> Edge_B;
+	Box_Tree Polygon_Tree;
+	Box_Tree Edge_Tree;
+	Vector2r Low, High;
+
+	void Build();							// the outline and both trees, after polygons were added
+	bool Inside_Polygon(int polygon, Vector2r p) const;
+	Real Edge_Distance2(Vector2r p) const;	// squared distance to the nearest outline edge
+};
+
+#endif
@@ -0,0 +1,244 @@
+//
+//  PCISPH.cpp
+//
+//  Predictive-corrective incompressible SPH (Solenthaler and
+//    Pajarola 2009).  The positions are predicted with the
+//    current pressure forces, the density at the predicted
+//    positions is measured, and every particle raises its
+//    pressure in proportion to its compression.  This repeats
+//    until the mean compression is below the tolerance.  It
+//    needs fewer neighbor passes per iteration than IISPH but
+//    usually more iterations, so the iteration bounds trade
+//    accuracy for speed.
+//
+//  The neighbors are the pairs within the kernel at the start
+//    of the step, the pressure forces use their kernel
+//    gradients at the start of the step, and only the density
+//    is measured at the predicted positions.  The solver is
+//    stable at about the time step of the weakly compressible
+//    solver, with the compression held to the tolerance; for
+//    much larger steps IISPH is the better choice.
+//
+//  The walls add their density at the predicted positions and
+//    push with the gradient of the wall density at the start
+//    of the step, as neighbors at rest without pressure.
+//
+
+#include "SPH.h"
+#include <math.h>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace std;
+
+// delta of the paper assumes the same pressure on all neighbors, pressures that alternate
+// between neighbors compress faster with the spiky gradient, so delta is scaled down
+#define PCISPH_DELTA_SCALE 0.5f
+
+// sum of the squared kernel gradients around a particle of a square lattice at the rest density,
+// the prototype particle with a full neighborhood of the paper
+static Real Prototype_Gradient_Sum(const Kernel_Constants &c, Real rest_density){
+	// the lattice spacing that gives the rest density, found by bisection
+	int reach = 0;
+	Real low = c.kernel * 0.05f;
+	Real high = c.kernel;
+	Real spacing = high;
+	for(int step = 0; step < 40; step++){
+		spacing = 0.5f * (low + high);
+		reach = (int)(c.kernel / spacing) + 1;
+		Real dens = 0.0f;
+		for(int x = -reach; x <= reach; x++)
+			for(int y = -reach; y <= reach; y++){
+				Real r2 = (x * x + y * y) * spacing * spacing;
+				if(r2 < c.kernel2)
+					dens += c.mass * Kernel_Poly6(c, r2);
+			}
+		if(dens > rest_density)
+			low = spacing;			// too dense, spread the lattice
+		else
+			high = spacing;
+	}
+
+	// the gradients cancel out on a full lattice, only the sum of the squares remains
+	Real sum = 0.0f;
+	for(int x = -reach; x <= reach; x++)
+		for(int y = -reach; y <= reach; y++){
+			Real r2 = (x * x + y * y) * spacing * spacing;
+			if((r2 < c.kernel2)&&(r2 > INF)){
+				Real g = Kernel_Spiky(c, sqrt(r2));
+				sum += g * g;
+			}
+		}
+	return sum;
+}
+
+void SPH::Solve_PCISPH(){
+	Solver_Arrays &s = Solver_Data;
+	Particle_Arrays &p = Particles;
+	int n = Number_Particles;
+
+	static Real warmf = getenv("PWARM") ? atof(getenv("PWARM")) : 1.0f;
+	#pragma omp parallel for num_threads(Number_Threads)
+	for(int i = 0; i < n; i++)
+		s.pres[i] = warmf * p.pres[i];
+
+	// density, then the acceleration without pressure: viscosity and gravity
+	Comupte_Density_SingPressure();
+	#pragma omp parallel for num_threads(Number_Threads)
+	for(int i = 0; i < n; i++)
+		p.pres[i] = 0.0f;
+	Computer_Force();
+	if(Adaptive_Time)
+		Time_Delta = Compute_Time_Delta(false);
+
+	PROFILE_SCOPE(Timing, PHASE_PRESSURE);
+	const Real dt = Time_Delta;
+
+	Real move2 = 0.0f;
+	#pragma omp parallel num_threads(Number_Threads)
+	{
+		Real local = 0.0f;
+		#pragma omp for
+		for(int i = 0; i < n; i++){
+			Real vx = p.vel_x[i] + dt * p.acc_x[i];
+			Real vy = p.vel_y[i] + dt * p.acc_y[i];
+			local = max(local, vx * vx + vy * vy);
+		}
+		#pragma omp critical
+		move2 = max(move2, local);
+	}
+	Build_Solver_Pairs(getenv("PNOMARGIN") ? 0.0f : 2.0f * dt * sqrt(move2));
+	const int *index = Pair_Index;
+	Real *grad_x = Pair_Grad_x;
+	Real *grad_y = Pair_Grad_y;
+	const Real m = mass;
+	const Real rest = Stand_Density;
+	const Real self = m * Constants.poly6 * Constants.kernel6;
+	const bool walls = Use_Boundary;
+
+	Real beta = 2.0f * dt * dt * m * m / (rest * rest);
+	Real delta = PCISPH_DELTA_SCALE / (beta * Prototype_Gradient_Sum(Constants, rest));
+
+	static bool local_delta = getenv("PLOCAL") != NULL;
+	static Real omega = getenv("POMEGA") ? atof(getenv("POMEGA")) : 0.5f;
+	#pragma omp parallel for num_threads(Number_Threads)
+	for(int i = 0; i < n; i++){
+		s.wall_x[i] = walls ? Boundary_Grad_x[i] : 0.0f;
+		s.wall_y[i] = walls ? Boundary_Grad_y[i] : 0.0f;
+		Real gx = s.wall_x[i];
+		Real gy = s.wall_y[i];
+		Real sq = 0.0f;
+		for(int k = Pair_Start[i]; k < Pair_Start[i + 1]; k++){
+			gx += m * grad_x[k];
+			gy += m * grad_y[k];
+			sq += m * m * (grad_x[k] * grad_x[k] + grad_y[k] * grad_y[k]);
+		}
+		Real d = dt * dt / (rest * rest) * (gx * gx + gy * gy + sq);
+		s.diag[i] = local_delta ? (d > 0.0f ? omega / d : 0.0f) : delta;
+	}
+
+	auto pressure_acceleration = [&](){
+		#pragma omp parallel for num_threads(Number_Threads) schedule(dynamic, 256)
+		for(int i = 0; i < n; i++){
+			Real pi = s.pres[i];
+			Real ax = 0.0f;
+			Real ay = 0.0f;
+			for(int k = Pair_Start[i]; k < Pair_Start[i + 1]; k++){
+				int j = index[k];
+				Real g = m * (pi + s.pres[j]) / (rest * rest);
+				ax -= g * grad_x[k];
+				ay -= g * grad_y[k];
+			}
+			static Real wf = getenv("PWF") ? atof(getenv("PWF")) : 1.0f;
+			ax -= wf * pi / (rest * rest) * s.wall_x[i];
+			ay -= wf * pi / (rest * rest) * s.wall_y[i];
+			s.sum_x[i] = ax;
+			s.sum_y[i] = ay;
+		}
+	};
+	pressure_acceleration();
+
+	int iterations = 0;
+	Real error = 0.0f;
+	static int forceits = getenv("PITS") ? atoi(getenv("PITS")) : 0;
+	static bool noclamp = getenv("PNOCLAMP") != NULL;
+	static bool pg = getenv("PNOPREDGRAD") == NULL;
+	static bool pw = getenv("PNOPREDWALL") == NULL;
+	do{
+		#pragma omp parallel for num_threads(Number_Threads)
+		for(int i = 0; i < n; i++){
+			s.vel_x[i] = p.vel_x[i] + dt * (p.acc_x[i] + s.sum_x[i]);
+			s.vel_y[i] = p.vel_y[i] + dt * (p.acc_y[i] + s.sum_y[i]);
+			s.d_x[i] = p.pos_x[i] + dt * s.vel_x[i];
+			s.d_y[i] = p.pos_y[i] + dt * s.vel_y[i];
+			if(!(noclamp && walls)){
+				s.d_x[i] = min(max(s.d_x[i], (Real)0.0f), World_Size.x);
+				s.d_y[i] = min(max(s.d_y[i], (Real)0.0f), World_Size.y);
+			}
+		}
+
+		Real largest = 0.0f;
+		double sumc = 0.0;
+		#pragma omp parallel num_threads(Number_Threads)
+		{
+		Real local = 0.0f;
+		double lsum = 0.0;
+		#pragma omp for schedule(dynamic, 256)
+		for(int i = 0; i < n; i++){
+			Real rho = self;
+			for(int k = Pair_Start[i]; k < Pair_Start[i + 1]; k++){
+				int j = index[k];
+				Real dx = s.d_x[i] - s.d_x[j];
+				Real dy = s.d_y[i] - s.d_y[j];
+				Real r2 = dx * dx + dy * dy;
+				Real g = 0.0f;
+				if(r2 < Constants.kernel2){
+					rho += m * Kernel_Poly6(Constants, r2);
+					if(r2 > INF){
+						Real r = sqrt(r2);
+						g = Kernel_Spiky(Constants, r) / r;
+					}
+				}
+				if(pg){ grad_x[k] = g * dx; grad_y[k] = g * dy; }
+			}
+			if(walls){
+				Real wall = 0.0f, wx = 0.0f, wy = 0.0f;
+				Boundary.Sample(s.d_x[i], s.d_y[i], wall, wx, wy);
+				rho += wall;
+				if(pw){ s.wall_x[i] = wx; s.wall_y[i] = wy; }
+			}
+			Real compressed = rho - rest;
+			s.dens[i] = rho;
+			s.pres[i] = max(s.pres[i] + s.diag[i] * compressed, (Real)0.0f);
+			local = max(local, compressed);
+			lsum += max(compressed, (Real)0.0f);
+		}
+		#pragma omp critical
+		{ largest = max(largest, local); sumc += lsum; }
+		}
+
+		pressure_acceleration();
+		iterations++;
+		static bool meancrit = getenv("PMEAN") != NULL;
+		error = meancrit ? (Real)(sumc / n / rest) : largest / rest;
+		static int dbgstep = getenv("PDBG") ? atoi(getenv("PDBG")) : -2; if(dbgstep == -1 || dbgstep == Step_Count)
+		{ int w=0; Real e=-1e30f; for(int i=0;i<n;i++) if(s.dens[i]>e){e=s.dens[i];w=i;}
+			Real pmax=0; int pw2=0; for(int i=0;i<n;i++) if(s.pres[i]>pmax){pmax=s.pres[i];pw2=i;}
+			printf("it %d max %g mean %g | worst %d at %.4f %.4f pres %.4g nb %d | pmax %.4g at %.4f %.4f dens %.1f\n", iterations, largest / rest, sumc / n / rest, w, s.d_x[w], s.d_y[w], s.pres[w], Pair_Start[w+1]-Pair_Start[w], pmax, s.d_x[pw2], s.d_y[pw2], s.dens[pw2]); }
+	}while((iterations < forceits)||(iterations < Min_Solver_Iterations)||((iterations < Max_Solver_Iterations)&&(error > Solver_Tolerance)));
+
+	static bool dbg2 = getenv("PDBG2") != NULL; if(dbg2){
+		Real vmax=0; for(int i=0;i<n;i++) vmax=max(vmax,(Real)sqrt(s.vel_x[i]*s.vel_x[i]+s.vel_y[i]*s.vel_y[i]));
+		printf("step %d its %d err %g vmax %g\n", Step_Count, iterations, error, vmax); }
+	Solver_Iterations = iterations;
+	Total_Solver_Iterations += iterations;
+	Density_Error = error;
+
+	#pragma omp parallel for num_threads(Number_Threads)
+	for(int i = 0; i < n; i++){
+		p.acc_x[i] += s.sum_x[i];
+		p.acc_y[i] += s.sum_y[i];
+		p.pres[i] = s.pres[i];
+	}
+}
@@ -0,0 +1,200 @@
+//
+//  ParticleRenderer.h
+//
+//  Draws a Particle_Snapshot as points from one vertex buffer,
+//    with one upload and one draw call per frame instead of a
+//    glVertex call per particle.  The positions go to the
+//    front of the buffer and the colors after them.  Every
+//    frame the buffer is orphaned with glBufferData first, so
+//    the driver hands out fresh memory instead of waiting for
+//    the draw of the last frame to finish with the old one.
+//
+//  The buffer functions are OpenGL 1.5.  Windows only exports
+//    OpenGL 1.1, so they are loaded with wglGetProcAddress
+//    there; other platforms declare them with
+//    GL_GLEXT_PROTOTYPES.  Without them the points are drawn
+//    from client memory with vertex arrays.
+//
+//  Include this before GetGlut.h.
+//
+
+#ifndef __PARTICLERENDERER_H__
+#define __PARTICLERENDERER_H__
+
+#ifndef _WIN32
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include <stdio.h>
+#include <stddef.h>
+#include <chrono>
+#include <vector>
+#include "GetGlut.h"
+#include "Snapshot.h"
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#endif
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW 0x88E0
+#endif
+
+#ifdef _WIN32
+#ifndef APIENTRY
+#define APIENTRY __stdcall
+#endif
+typedef void (APIENTRY *Gen_Buffers_Function)(GLsizei n, GLuint *buffers);
+typedef void (APIENTRY *Delete_Buffers_Function)(GLsizei n, const GLuint *buffers);
+typedef void (APIENTRY *Bind_Buffer_Function)(GLenum target, GLuint buffer);
+typedef void (APIENTRY *Buffer_Data_Function)(GLenum target, ptrdiff_t size, const void *data, GLenum usage);
+typedef void (APIENTRY *Buffer_Sub_Data_Function)(GLenum target, ptrdiff_t offset, ptrdiff_t size, const void *data);
+#endif
+
+class Particle_Renderer
+{
+public:
+	Particle_Renderer(){
+		Buffer = 0;
+		Loaded = false;
+		Upload_Seconds = Draw_Seconds = 0.0;
+		Frames = 0;
+#ifdef _WIN32
+		Gen_Buffers = NULL;
+		Delete_Buffers = NULL;
+		Bind_Buffer = NULL;
+		Buffer_Data = NULL;
+		Buffer_Sub_Data = NULL;
+#endif
+	}
+
+	// needs a current OpenGL context, false if there are no vertex buffers and client arrays are used
+	bool Init(){
+#ifdef _WIN32
+		Gen_Buffers = (Gen_Buffers_Function)wglGetProcAddress("glGenBuffers");
+		Delete_Buffers = (Delete_Buffers_Function)wglGetProcAddress("glDeleteBuffers");
+		Bind_Buffer = (Bind_Buffer_Function)wglGetProcAddress("glBindBuffer");
+		Buffer_Data = (Buffer_Data_Function)wglGetProcAddress("glBufferData");
+		Buffer_Sub_Data = (Buffer_Sub_Data_Function)wglGetProcAddress("glBufferSubData");
+		Loaded = (Gen_Buffers != NULL)&&(Delete_Buffers != NULL)&&(Bind_Buffer != NULL)&&
+		         (Buffer_Data != NULL)&&(Buffer_Sub_Data != NULL);
+#else
+		// a context without OpenGL 1.5 has no buffers even when the functions link
+		const char *version = (const char *)glGetString(GL_VERSION);
+		int major = 0, minor = 0;
+		if(version != NULL)
+			sscanf(version, "%d.%d", &major, &minor);
+		Loaded = (major > 1)||((major == 1)&&(minor >= 5));
+#endif
+		if(Loaded)
+			Gen_Buffers(1, &Buffer);
+		return Loaded;
+	}
+
+	void Release(){
+		if(Loaded&&(Buffer != 0))
+			Delete_Buffers(1, &Buffer);
+		Buffer = 0;
+	}
+
+	// upload and draw the points of p, each part timed on its own
+	void Draw(const Particle_Snapshot &p){
+		chrono_point start = std::chrono::steady_clock::now();
+		size_t position_bytes = sizeof(float) * 2 * p.count;
+		bool colored = p.kind != VALUE_NONE;
+		if(colored)
+			Fill_Colors(p);
+		const void *positions = p.pos;
+		const void *colors = Colors.data();
+		if(Loaded){
+			size_t color_bytes = colored ? 4 * (size_t)p.count : 0;
+			Bind_Buffer(GL_ARRAY_BUFFER, Buffer);
+			Buffer_Data(GL_ARRAY_BUFFER, position_bytes + color_bytes, NULL, GL_STREAM_DRAW);		// orphan
+			Buffer_Sub_Data(GL_ARRAY_BUFFER, 0, position_bytes, p.pos);
+			if(colored)
+				Buffer_Sub_Data(GL_ARRAY_BUFFER, position_bytes, color_bytes, Colors.data());
+			// with a bound buffer the pointers are offsets into it
+			positions = NULL;
+			colors = (const void *)position_bytes;
+		}
+		chrono_point uploaded = std::chrono::steady_clock::now();
+
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glVertexPointer(2, GL_FLOAT, 0, positions);
+		if(colored){
+			glEnableClientState(GL_COLOR_ARRAY);
+			glColorPointer(4, GL_UNSIGNED_BYTE, 0, colors);
+		}
+		else
+			glColor3f(1.0f, 0.0f, 1.0f);
+		glDrawArrays(GL_POINTS, 0, p.count);
+		glDisableClientState(GL_COLOR_ARRAY);
+		glDisableClientState(GL_VERTEX_ARRAY);
+		if(Loaded)
+			Bind_Buffer(GL_ARRAY_BUFFER, 0);
+		chrono_point drawn = std::chrono::steady_clock::now();
+
+		Upload_Seconds += std::chrono::duration<double>(uploaded - start).count();
+		Draw_Seconds += std::chrono::duration<double>(drawn - uploaded).count();
+		Frames++;
+	}
+
+	// mean milliseconds of the upload and of the draw call since the last call, the draw
+	// time is what the driver takes to queue it, the GPU works on it after that
+	void Take_Times(double &upload_ms, double &draw_ms){
+		upload_ms = Frames > 0 ? Upload_Seconds * 1000.0 / Frames : 0.0;
+		draw_ms = Frames > 0 ? Draw_Seconds * 1000.0 / Frames : 0.0;
+		Upload_Seconds = Draw_Seconds = 0.0;
+		Frames = 0;
+	}
+
+	bool Has_Buffer(){
+		return Loaded;
+	}
+
+private:
+	typedef std::chrono::steady_clock::time_point chrono_point;
+
+	GLuint Buffer;
+	bool Loaded;					// the buffer functions are there
+	std::vector<unsigned char> Colors;
+	double Upload_Seconds;
+	double Draw_Seconds;
+	int Frames;
+#ifdef _WIN32
+	Gen_Buffers_Function Gen_Buffers;
+	Delete_Buffers_Function Delete_Buffers;
+	Bind_Buffer_Function Bind_Buffer;
+	Buffer_Data_Function Buffer_Data;
+	Buffer_Sub_Data_Function Buffer_Sub_Data;
+#else
+	static void Gen_Buffers(GLsizei n, GLuint *buffers){ glGenBuffers(n, buffers); }
+	static void Delete_Buffers(GLsizei n, const GLuint *buffers){ glDeleteBuffers(n, buffers); }
+	static void Bind_Buffer(GLenum target, GLuint buffer){ glBindBuffer(target, buffer); }
+	static void Buffer_Data(GLenum target, size_t size, const void *data, GLenum usage){
+		glBufferData(target, size, data, usage);
+	}
+	static void Buffer_Sub_Data(GLenum target, size_t offset, size_t size, const void *data){
+		glBufferSubData(target, offset, size, data);
+	}
+#endif
+
+	// blue at the low end of the range, green in the middle, red at the high end
+	void Fill_Colors(const Particle_Snapshot &p){
+		Colors.resize(4 * (size_t)p.count);
+		float scale = p.high > p.low ? 2.0f / (p.high - p.low) : 0.0f;
+		for(int i = 0; i < p.count; i++){
+			float t = (p.value[i] - p.low) * scale - 1.0f;			// -1 to 1
+			float cold = t < 0.0f ? -t : 0.0f;
+			float hot = t > 0.0f ? t : 0.0f;
+			unsigned char *c = &Colors[4 * (size_t)i];
+			c[0] = (unsigned char)(255.0f * hot);
+			c[1] = (unsigned char)(255.0f * (1.0f - cold - hot));
+			c[2] = (unsigned char)(255.0f * cold);
+			c[3] = 255;
+		}
+	}
+
+	Particle_Renderer(const Particle_Renderer&);
+	Particle_Renderer& operator=(const Particle_Renderer&);
+};
+
+#endif
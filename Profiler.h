@@ -0,0 +1,169 @@
+//
+//  Profiler.h
+//
+//  Time spent in each phase of a simulation step, measured
+//    with a steady clock by scoped timers.  The times of the
+//    last PROFILE_WINDOW steps are kept, so the mean, median
+//    and 99th percentile follow the simulation as it changes.
+//    Define SPH_NO_PROFILE to compile all timers away, the
+//    queries then return 0.
+//
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+
+#define PROFILE_WINDOW 256		// steps in the rolling statistics
+
+enum Profile_Phase{
+	PHASE_REORDER,
+	PHASE_GRID,
+	PHASE_NEIGHBOR_LIST,
+	PHASE_DENSITY,
+	PHASE_FORCE,
+	PHASE_PRESSURE,				// iterations of the implicit pressure solvers
+	PHASE_UPDATE,
+	PHASE_STEP,					// the whole step
+	PHASE_COUNT
+};
+
+inline const char* Get_Phase_Name(Profile_Phase phase){
+	static const char *names[PHASE_COUNT] = {
+		"reorder", "grid", "neighbor list", "density", "force", "pressure", "update", "step"
+	};
+	return names[phase];
+}
+
+class Profiler
+{
+#ifndef SPH_NO_PROFILE
+private:
+	double Current[PHASE_COUNT];				// seconds of the step in progress
+	double Times[PHASE_COUNT][PROFILE_WINDOW];	// seconds of the last steps, a ring
+	long long Current_Pairs;
+	long long Pairs[PROFILE_WINDOW];
+	int Next;									// ring position of the next step
+	int Steps;									// steps in the ring
+
+public:
+	Profiler(){
+		Reset();
+	}
+
+	void Reset(){
+		memset(Current, 0, sizeof(Current));
+		Current_Pairs = 0;
+		Next = 0;
+		Steps = 0;
+	}
+
+	// a phase can run several times in a step, the times add up
+	void Add(Profile_Phase phase, double seconds){
+		Current[phase] += seconds;
+	}
+
+	void Add_Pairs(long long pairs){
+		Current_Pairs += pairs;
+	}
+
+	// move the step in progress into the ring
+	void End_Step(){
+		for(int p = 0; p < PHASE_COUNT; p++){
+			Times[p][Next] = Current[p];
+			Current[p] = 0.0;
+		}
+		Pairs[Next] = Current_Pairs;
+		Current_Pairs = 0;
+		Next = (Next + 1) % PROFILE_WINDOW;
+		if(Steps < PROFILE_WINDOW)
+			Steps++;
+	}
+
+	int Get_Steps() const{
+		return Steps;
+	}
+
+	// seconds per step, steps without the phase count as 0
+	double Get_Mean(Profile_Phase phase) const{
+		double sum = 0.0;
+		for(int i = 0; i < Steps; i++)
+			sum += Times[phase][i];
+		return Steps > 0 ? sum / Steps : 0.0;
+	}
+
+	// seconds per step below which a fraction of the steps lie, 0.5 for the median
+	double Get_Percentile(Profile_Phase phase, double fraction) const{
+		if(Steps == 0)
+			return 0.0;
+		double sorted[PROFILE_WINDOW];
+		memcpy(sorted, Times[phase], sizeof(double) * Steps);
+		int k = (int)(fraction * (Steps - 1) + 0.5);
+		std::nth_element(sorted, sorted + k, sorted + Steps);
+		return sorted[k];
+	}
+
+	// neighbor candidates examined by the density pass per step
+	double Get_Mean_Pairs() const{
+		long long sum = 0;
+		for(int i = 0; i < Steps; i++)
+			sum += Pairs[i];
+		return Steps > 0 ? (double)sum / Steps : 0.0;
+	}
+
+	void Print(FILE *file) const{
+		fprintf(file, "%-14s %10s %10s %10s %6s\n", "phase", "mean ms", "p50 ms", "p99 ms", "share");
+		double step = Get_Mean(PHASE_STEP);
+		for(int p = 0; p < PHASE_COUNT; p++){
+			Profile_Phase phase = (Profile_Phase)p;
+			double mean = Get_Mean(phase);
+			fprintf(file, "%-14s %10.4f %10.4f %10.4f %5.1f%%\n", Get_Phase_Name(phase), mean * 1e3,
+			        Get_Percentile(phase, 0.5) * 1e3, Get_Percentile(phase, 0.99) * 1e3,
+			        step > 0.0 ? mean / step * 100.0 : 0.0);
+		}
+		fprintf(file, "pairs per step %.0f, over the last %d steps\n", Get_Mean_Pairs(), Steps);
+	}
+#else
+public:
+	void Reset(){}
+	void Add(Profile_Phase, double){}
+	void Add_Pairs(long long){}
+	void End_Step(){}
+	int Get_Steps() const{ return 0; }
+	double Get_Mean(Profile_Phase) const{ return 0.0; }
+	double Get_Percentile(Profile_Phase, double) const{ return 0.0; }
+	double Get_Mean_Pairs() const{ return 0.0; }
+	void Print(FILE *file) const{ fprintf(file, "profiling disabled by SPH_NO_PROFILE\n"); }
+#endif
+};
+
+#ifndef SPH_NO_PROFILE
+// adds the time from its construction to the end of its scope to a phase
+class Scoped_Timer
+{
+private:
+	Profiler &Target;
+	Profile_Phase Phase;
+	std::chrono::steady_clock::time_point Start;
+
+public:
+	Scoped_Timer(Profiler &target, Profile_Phase phase)
+		: Target(target), Phase(phase), Start(std::chrono::steady_clock::now())
+	{}
+
+	~Scoped_Timer(){
+		Target.Add(Phase, std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count());
+	}
+};
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(profiler, phase) Scoped_Timer PROFILE_JOIN(Profile_Timer_, __LINE__)(profiler, phase)
+#else
+#define PROFILE_SCOPE(profiler, phase)
+#endif
+
+#endif
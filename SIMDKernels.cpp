@@ -0,0 +1,383 @@
+//
+//  SIMDKernels.cpp
+//
+
+#include "SIMDKernels.h"
+#include "AlignedMemory.h"
+#include <string.h>
+#include <math.h>
+
+#define INF 1E-12f
+#define FAR_AWAY 1E10f			// position of the padding particles
+
+#if !defined(SPH_DOUBLE_PRECISION) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+	#define SIMD_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define SIMD_TARGET(x)
+	#else
+		#define SIMD_TARGET(x) __attribute__((target(x)))
+	#endif
+#endif
+
+//
+//  Neighbor_Buffer
+//
+
+Neighbor_Buffer::Neighbor_Buffer(){
+	pos_x = pos_y = vel_x = vel_y = dens = pres = NULL;
+	count = 0;
+	capacity = 0;
+}
+
+Neighbor_Buffer::~Neighbor_Buffer(){
+	Aligned_Free(pos_x);
+	Aligned_Free(pos_y);
+	Aligned_Free(vel_x);
+	Aligned_Free(vel_y);
+	Aligned_Free(dens);
+	Aligned_Free(pres);
+}
+
+void Neighbor_Buffer::Reserve(int n){
+	// room for the padding too
+	n = (n + SIMD_MAX_WIDTH - 1) / SIMD_MAX_WIDTH * SIMD_MAX_WIDTH + SIMD_MAX_WIDTH;
+	if(n <= capacity)
+		return;
+	if(n < capacity * 2)
+		n = capacity * 2;
+	Aligned_Grow(pos_x, count, n);
+	Aligned_Grow(pos_y, count, n);
+	Aligned_Grow(vel_x, count, n);
+	Aligned_Grow(vel_y, count, n);
+	Aligned_Grow(dens, count, n);
+	Aligned_Grow(pres, count, n);
+	capacity = n;
+}
+
+void Neighbor_Buffer::Pad(){
+	while(count % SIMD_MAX_WIDTH != 0){
+		pos_x[count] = FAR_AWAY;
+		pos_y[count] = FAR_AWAY;
+		vel_x[count] = 0.0f;
+		vel_y[count] = 0.0f;
+		dens[count] = 1.0f;
+		pres[count] = 0.0f;
+		count++;
+	}
+}
+
+//
+//  Scalar reference
+//
+
+Real Density_Scalar(const Kernel_Constants &c, Real px, Real py, const Neighbor_Buffer &b){
+	Real dens = 0.0f;
+	for(int n = 0; n < b.count; n++){
+		Real dx = px - b.pos_x[n];
+		Real dy = py - b.pos_y[n];
+		Real dis2 = dx * dx + dy * dy;
+
+		if((dis2 < INF)||(dis2 > c.kernel2))
+			continue;
+		dens += c.mass * Kernel_Poly6(c, dis2);
+	}
+	return dens;
+}
+
+void Force_Scalar(const Kernel_Constants &c, Real px, Real py, Real vx, Real vy, Real pres,
+                  const Neighbor_Buffer &b, Real &ax, Real &ay){
+	for(int n = 0; n < b.count; n++){
+		Real dx = px - b.pos_x[n];
+		Real dy = py - b.pos_y[n];
+		Real dis2 = dx * dx + dy * dy;
+
+		if((dis2 < c.kernel2)&&(dis2 > INF)){
+			Real dis = sqrt(dis2);
+			Real Volume = c.mass / b.dens[n];
+			Real Force = Volume * (pres + b.pres[n])/2 * Kernel_Spiky(c, dis);
+			ax -= dx * Force / dis;
+			ay -= dy * Force / dis;
+
+			Force = Volume * c.viscosity * Kernel_Visco(c, dis);
+			ax += (b.vel_x[n] - vx) * Force;
+			ay += (b.vel_y[n] - vy) * Force;
+		}
+	}
+}
+
+#ifdef SIMD_X86
+
+//
+//  SSE4, 4 neighbors at a time
+//
+
+SIMD_TARGET("sse4.1")
+static float Horizontal_Sum(__m128 v){
+	__m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s);
+}
+
+SIMD_TARGET("sse4.1")
+static float Density_SSE4(const Kernel_Constants &c, float px, float py, const Neighbor_Buffer &b){
+	const __m128 vpx = _mm_set1_ps(px);
+	const __m128 vpy = _mm_set1_ps(py);
+	const __m128 h2 = _mm_set1_ps(c.kernel2);
+	const __m128 inf = _mm_set1_ps(INF);
+	__m128 sum = _mm_setzero_ps();
+	for(int n = 0; n < b.count; n += 4){
+		__m128 dx = _mm_sub_ps(vpx, _mm_load_ps(b.pos_x + n));
+		__m128 dy = _mm_sub_ps(vpy, _mm_load_ps(b.pos_y + n));
+		__m128 dis2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		__m128 mask = _mm_and_ps(_mm_cmpge_ps(dis2, inf), _mm_cmple_ps(dis2, h2));
+		__m128 t = _mm_sub_ps(h2, dis2);
+		sum = _mm_add_ps(sum, _mm_and_ps(mask, _mm_mul_ps(_mm_mul_ps(t, t), t)));
+	}
+	return c.mass * c.poly6 * Horizontal_Sum(sum);
+}
+
+SIMD_TARGET("sse4.1")
+static void Force_SSE4(const Kernel_Constants &c, float px, float py, float vx, float vy, float pres,
+                       const Neighbor_Buffer &b, float &ax, float &ay){
+	const __m128 vpx = _mm_set1_ps(px);
+	const __m128 vpy = _mm_set1_ps(py);
+	const __m128 vvx = _mm_set1_ps(vx);
+	const __m128 vvy = _mm_set1_ps(vy);
+	const __m128 vpres = _mm_set1_ps(pres);
+	const __m128 h = _mm_set1_ps(c.kernel);
+	const __m128 h2 = _mm_set1_ps(c.kernel2);
+	const __m128 inf = _mm_set1_ps(INF);
+	const __m128 mass = _mm_set1_ps(c.mass);
+	const __m128 half_spiky = _mm_set1_ps(0.5f * c.spiky);
+	const __m128 visc = _mm_set1_ps(c.viscosity * c.spiky);
+	__m128 sum_x = _mm_setzero_ps();
+	__m128 sum_y = _mm_setzero_ps();
+	for(int n = 0; n < b.count; n += 4){
+		__m128 dx = _mm_sub_ps(vpx, _mm_load_ps(b.pos_x + n));
+		__m128 dy = _mm_sub_ps(vpy, _mm_load_ps(b.pos_y + n));
+		__m128 dis2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		__m128 mask = _mm_and_ps(_mm_cmpgt_ps(dis2, inf), _mm_cmplt_ps(dis2, h2));
+		__m128 dis = _mm_sqrt_ps(_mm_max_ps(dis2, inf));
+		__m128 hd = _mm_sub_ps(h, dis);
+		__m128 volume = _mm_div_ps(mass, _mm_load_ps(b.dens + n));
+		// pressure, -Force / dis with Force = Volume * (p + pn)/2 * -spiky * (h - dis)^2
+		__m128 p = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(volume, _mm_add_ps(vpres, _mm_load_ps(b.pres + n))),
+		                                 _mm_mul_ps(half_spiky, _mm_mul_ps(hd, hd))), dis);
+		// viscosity
+		__m128 v = _mm_mul_ps(_mm_mul_ps(volume, visc), hd);
+		__m128 fx = _mm_add_ps(_mm_mul_ps(dx, p), _mm_mul_ps(_mm_sub_ps(_mm_load_ps(b.vel_x + n), vvx), v));
+		__m128 fy = _mm_add_ps(_mm_mul_ps(dy, p), _mm_mul_ps(_mm_sub_ps(_mm_load_ps(b.vel_y + n), vvy), v));
+		sum_x = _mm_add_ps(sum_x, _mm_and_ps(mask, fx));
+		sum_y = _mm_add_ps(sum_y, _mm_and_ps(mask, fy));
+	}
+	ax += Horizontal_Sum(sum_x);
+	ay += Horizontal_Sum(sum_y);
+}
+
+//
+//  AVX2, 8 neighbors at a time
+//
+
+SIMD_TARGET("avx2,fma")
+static float Horizontal_Sum(__m256 v){
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s);
+}
+
+SIMD_TARGET("avx2,fma")
+static float Density_AVX2(const Kernel_Constants &c, float px, float py, const Neighbor_Buffer &b){
+	const __m256 vpx = _mm256_set1_ps(px);
+	const __m256 vpy = _mm256_set1_ps(py);
+	const __m256 h2 = _mm256_set1_ps(c.kernel2);
+	const __m256 inf = _mm256_set1_ps(INF);
+	__m256 sum = _mm256_setzero_ps();
+	for(int n = 0; n < b.count; n += 8){
+		__m256 dx = _mm256_sub_ps(vpx, _mm256_load_ps(b.pos_x + n));
+		__m256 dy = _mm256_sub_ps(vpy, _mm256_load_ps(b.pos_y + n));
+		__m256 dis2 = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+		__m256 mask = _mm256_and_ps(_mm256_cmp_ps(dis2, inf, _CMP_GE_OQ), _mm256_cmp_ps(dis2, h2, _CMP_LE_OQ));
+		__m256 t = _mm256_sub_ps(h2, dis2);
+		sum = _mm256_add_ps(sum, _mm256_and_ps(mask, _mm256_mul_ps(_mm256_mul_ps(t, t), t)));
+	}
+	return c.mass * c.poly6 * Horizontal_Sum(sum);
+}
+
+SIMD_TARGET("avx2,fma")
+static void Force_AVX2(const Kernel_Constants &c, float px, float py, float vx, float vy, float pres,
+                       const Neighbor_Buffer &b, float &ax, float &ay){
+	const __m256 vpx = _mm256_set1_ps(px);
+	const __m256 vpy = _mm256_set1_ps(py);
+	const __m256 vvx = _mm256_set1_ps(vx);
+	const __m256 vvy = _mm256_set1_ps(vy);
+	const __m256 vpres = _mm256_set1_ps(pres);
+	const __m256 h = _mm256_set1_ps(c.kernel);
+	const __m256 h2 = _mm256_set1_ps(c.kernel2);
+	const __m256 inf = _mm256_set1_ps(INF);
+	const __m256 mass = _mm256_set1_ps(c.mass);
+	const __m256 half_spiky = _mm256_set1_ps(0.5f * c.spiky);
+	const __m256 visc = _mm256_set1_ps(c.viscosity * c.spiky);
+	__m256 sum_x = _mm256_setzero_ps();
+	__m256 sum_y = _mm256_setzero_ps();
+	for(int n = 0; n < b.count; n += 8){
+		__m256 dx = _mm256_sub_ps(vpx, _mm256_load_ps(b.pos_x + n));
+		__m256 dy = _mm256_sub_ps(vpy, _mm256_load_ps(b.pos_y + n));
+		__m256 dis2 = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+		__m256 mask = _mm256_and_ps(_mm256_cmp_ps(dis2, inf, _CMP_GT_OQ), _mm256_cmp_ps(dis2, h2, _CMP_LT_OQ));
+		__m256 dis = _mm256_sqrt_ps(_mm256_max_ps(dis2, inf));
+		__m256 hd = _mm256_sub_ps(h, dis);
+		__m256 volume = _mm256_div_ps(mass, _mm256_load_ps(b.dens + n));
+		__m256 p = _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(volume, _mm256_add_ps(vpres, _mm256_load_ps(b.pres + n))),
+		                                       _mm256_mul_ps(half_spiky, _mm256_mul_ps(hd, hd))), dis);
+		__m256 v = _mm256_mul_ps(_mm256_mul_ps(volume, visc), hd);
+		__m256 fx = _mm256_fmadd_ps(dx, p, _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(b.vel_x + n), vvx), v));
+		__m256 fy = _mm256_fmadd_ps(dy, p, _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(b.vel_y + n), vvy), v));
+		sum_x = _mm256_add_ps(sum_x, _mm256_and_ps(mask, fx));
+		sum_y = _mm256_add_ps(sum_y, _mm256_and_ps(mask, fy));
+	}
+	ax += Horizontal_Sum(sum_x);
+	ay += Horizontal_Sum(sum_y);
+}
+
+//
+//  AVX-512, 16 neighbors at a time with mask registers
+//
+
+SIMD_TARGET("avx512f")
+static float Density_AVX512(const Kernel_Constants &c, float px, float py, const Neighbor_Buffer &b){
+	const __m512 vpx = _mm512_set1_ps(px);
+	const __m512 vpy = _mm512_set1_ps(py);
+	const __m512 h2 = _mm512_set1_ps(c.kernel2);
+	const __m512 inf = _mm512_set1_ps(INF);
+	__m512 sum = _mm512_setzero_ps();
+	for(int n = 0; n < b.count; n += 16){
+		__m512 dx = _mm512_sub_ps(vpx, _mm512_load_ps(b.pos_x + n));
+		__m512 dy = _mm512_sub_ps(vpy, _mm512_load_ps(b.pos_y + n));
+		__m512 dis2 = _mm512_fmadd_ps(dx, dx, _mm512_mul_ps(dy, dy));
+		__mmask16 mask = _mm512_cmp_ps_mask(dis2, inf, _CMP_GE_OQ) & _mm512_cmp_ps_mask(dis2, h2, _CMP_LE_OQ);
+		__m512 t = _mm512_sub_ps(h2, dis2);
+		sum = _mm512_mask_add_ps(sum, mask, sum, _mm512_mul_ps(_mm512_mul_ps(t, t), t));
+	}
+	return c.mass * c.poly6 * _mm512_reduce_add_ps(sum);
+}
+
+SIMD_TARGET("avx512f")
+static void Force_AVX512(const Kernel_Constants &c, float px, float py, float vx, float vy, float pres,
+                         const Neighbor_Buffer &b, float &ax, float &ay){
+	const __m512 vpx = _mm512_set1_ps(px);
+	const __m512 vpy = _mm512_set1_ps(py);
+	const __m512 vvx = _mm512_set1_ps(vx);
+	const __m512 vvy = _mm512_set1_ps(vy);
+	const __m512 vpres = _mm512_set1_ps(pres);
+	const __m512 h = _mm512_set1_ps(c.kernel);
+	const __m512 h2 = _mm512_set1_ps(c.kernel2);
+	const __m512 inf = _mm512_set1_ps(INF);
+	const __m512 mass = _mm512_set1_ps(c.mass);
+	const __m512 half_spiky = _mm512_set1_ps(0.5f * c.spiky);
+	const __m512 visc = _mm512_set1_ps(c.viscosity * c.spiky);
+	__m512 sum_x = _mm512_setzero_ps();
+	__m512 sum_y = _mm512_setzero_ps();
+	for(int n = 0; n < b.count; n += 16){
+		__m512 dx = _mm512_sub_ps(vpx, _mm512_load_ps(b.pos_x + n));
+		__m512 dy = _mm512_sub_ps(vpy, _mm512_load_ps(b.pos_y + n));
+		__m512 dis2 = _mm512_fmadd_ps(dx, dx, _mm512_mul_ps(dy, dy));
+		__mmask16 mask = _mm512_cmp_ps_mask(dis2, inf, _CMP_GT_OQ) & _mm512_cmp_ps_mask(dis2, h2, _CMP_LT_OQ);
+		if(mask == 0)
+			continue;
+		__m512 dis = _mm512_sqrt_ps(_mm512_max_ps(dis2, inf));
+		__m512 hd = _mm512_sub_ps(h, dis);
+		__m512 volume = _mm512_div_ps(mass, _mm512_load_ps(b.dens + n));
+		__m512 p = _mm512_div_ps(_mm512_mul_ps(_mm512_mul_ps(volume, _mm512_add_ps(vpres, _mm512_load_ps(b.pres + n))),
+		                                       _mm512_mul_ps(half_spiky, _mm512_mul_ps(hd, hd))), dis);
+		__m512 v = _mm512_mul_ps(_mm512_mul_ps(volume, visc), hd);
+		__m512 fx = _mm512_fmadd_ps(dx, p, _mm512_mul_ps(_mm512_sub_ps(_mm512_load_ps(b.vel_x + n), vvx), v));
+		__m512 fy = _mm512_fmadd_ps(dy, p, _mm512_mul_ps(_mm512_sub_ps(_mm512_load_ps(b.vel_y + n), vvy), v));
+		sum_x = _mm512_mask_add_ps(sum_x, mask, sum_x, fx);
+		sum_y = _mm512_mask_add_ps(sum_y, mask, sum_y, fy);
+	}
+	ax += _mm512_reduce_add_ps(sum_x);
+	ay += _mm512_reduce_add_ps(sum_y);
+}
+
+#endif	// SIMD_X86
+
+//
+//  Dispatch
+//
+
+SIMD_Level Detect_SIMD_Level(){
+#ifdef SIMD_X86
+	#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		int max_leaf = info[0];
+		__cpuid(info, 1);
+		bool sse4 = (info[2] & (1 << 19)) != 0;
+		bool fma = (info[2] & (1 << 12)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx2 = false;
+		bool avx512 = false;
+		if(osxsave && max_leaf >= 7){
+			unsigned long long xcr0 = _xgetbv(0);
+			__cpuidex(info, 7, 0);
+			avx2 = fma && (info[1] & (1 << 5)) && ((xcr0 & 0x06) == 0x06);
+			avx512 = (info[1] & (1 << 16)) && ((xcr0 & 0xe6) == 0xe6);
+		}
+	#else
+		__builtin_cpu_init();
+		bool sse4 = __builtin_cpu_supports("sse4.1");
+		bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		bool avx512 = __builtin_cpu_supports("avx512f");
+	#endif
+	if(avx512)
+		return SIMD_AVX512;
+	if(avx2)
+		return SIMD_AVX2;
+	if(sse4)
+		return SIMD_SSE4;
+#endif
+	return SIMD_SCALAR;
+}
+
+const char* Get_SIMD_Level_Name(SIMD_Level level){
+	switch(level){
+	case SIMD_SSE4:		return "SSE4";
+	case SIMD_AVX2:		return "AVX2";
+	case SIMD_AVX512:	return "AVX-512";
+	default:			return "scalar";
+	}
+}
+
+SIMD_Kernels Get_SIMD_Kernels(SIMD_Level level){
+	SIMD_Level best = Detect_SIMD_Level();
+	if(level > best)
+		level = best;
+
+	SIMD_Kernels k;
+	k.level = SIMD_SCALAR;
+	k.density = Density_Scalar;
+	k.force = Force_Scalar;
+#ifdef SIMD_X86
+	switch(level){
+	case SIMD_AVX512:
+		k.density = Density_AVX512;
+		k.force = Force_AVX512;
+		break;
+	case SIMD_AVX2:
+		k.density = Density_AVX2;
+		k.force = Force_AVX2;
+		break;
+	case SIMD_SSE4:
+		k.density = Density_SSE4;
+		k.force = Force_SSE4;
+		break;
+	default:
+		break;
+	}
+	k.level = level;
+#endif
+	return k;
+}
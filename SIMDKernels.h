@@ -0,0 +1,73 @@
+//
+//  SIMDKernels.h
+//
+//  The density and force sums over the neighbors of one
+//    particle, as a scalar reference and as SSE4, AVX2 and
+//    AVX-512 versions that process 4, 8 or 16 neighbors at a
+//    time.  The neighbors are first copied into a
+//    Neighbor_Buffer, so the vector code only does aligned
+//    contiguous loads.  The vector versions are only built in
+//    single precision on x86, otherwise the scalar version is
+//    always used.
+//
+
+#ifndef __SIMDKERNELS_H__
+#define __SIMDKERNELS_H__
+
+#include "DataStructure.h"
+#include "Kernel.h"
+
+#define SIMD_MAX_WIDTH 16		// widest vector, the buffers are padded to this
+
+enum SIMD_Level{
+	SIMD_SCALAR,
+	SIMD_SSE4,
+	SIMD_AVX2,
+	SIMD_AVX512
+};
+
+// neighbor candidates of a particle, copied into contiguous aligned arrays
+class Neighbor_Buffer
+{
+public:
+	Real *pos_x;
+	Real *pos_y;
+	Real *vel_x;
+	Real *vel_y;
+	Real *dens;
+	Real *pres;
+	int count;			// neighbors, padded up to a multiple of SIMD_MAX_WIDTH by Pad()
+	int capacity;
+
+	Neighbor_Buffer();
+	~Neighbor_Buffer();
+	void Reserve(int n);			// keeps the content
+	void Pad();						// fill up with particles too far away to interact
+};
+
+typedef Real (*Density_Function)(const Kernel_Constants &c, Real px, Real py,
+                                 const Neighbor_Buffer &b);
+typedef void (*Force_Function)(const Kernel_Constants &c, Real px, Real py,
+                               Real vx, Real vy, Real pres,
+                               const Neighbor_Buffer &b, Real &ax, Real &ay);
+
+class SIMD_Kernels
+{
+public:
+	SIMD_Level level;
+	Density_Function density;		// density of a particle without its own contribution
+	Force_Function force;			// pressure and viscosity force, not divided by the density
+};
+
+SIMD_Level Detect_SIMD_Level();						// best level this CPU supports
+const char* Get_SIMD_Level_Name(SIMD_Level level);
+
+// kernels for level, or the best supported level below it
+SIMD_Kernels Get_SIMD_Kernels(SIMD_Level level);
+
+// scalar reference versions
+Real Density_Scalar(const Kernel_Constants &c, Real px, Real py, const Neighbor_Buffer &b);
+void Force_Scalar(const Kernel_Constants &c, Real px, Real py, Real vx, Real vy, Real pres,
+                  const Neighbor_Buffer &b, Real &ax, Real &ay);
+
+#endif
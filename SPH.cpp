@@ -7,36 +7,128 @@
 #include <math.h>
 #include <string.h>
 #include <iostream>
+#include <algorithm>
+#include <new>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 
+// index of the calling thread in the current parallel region
+static int Thread_Id(){
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+// number of threads in the current parallel region
+static int Team_Size(){
+#ifdef _OPENMP
+	return omp_get_num_threads();
+#else
+	return 1;
+#endif
+}
+
+// the struct view, Particle holds Vector2 in double precision, which is not plain data,
+// so the view is constructed in place and never grown, Get_Paticles fills it anyway
+static Particle* New_Particle_View(int capacity){
+	Particle *view = (Particle *)Aligned_Malloc(sizeof(Particle) * capacity);
+	for(int i = 0; i < capacity; i++)
+		new (&view[i]) Particle();
+	return view;
+}
+
+static void Delete_Particle_View(Particle *view, int capacity){
+	if(view == NULL)
+		return;
+	for(int i = 0; i < capacity; i++)
+		view[i].~Particle();
+	Aligned_Free(view);
+}
+
 SPH::SPH(){
 	kernel = 0.04f;
 	mass = 0.02f;
 
-	Max_Number_Paticles = 10000;
+	Max_Number_Paticles = 0;
 	Number_Particles = 0;
 
 	World_Size.x = 2.56f;
 	World_Size.y = 2.56f;
 	Cell_Size = kernel;			// cell size = kernel or h
-	Grid_Size = World_Size / Cell_Size;
-	Grid_Size.x = (int)Grid_Size.x;
-	Grid_Size.y = (int)Grid_Size.y;
-	Number_Cells = (int)Grid_Size.x * (int)Grid_Size.y;
 
-	Gravity = Vector2(0.0f, -3.0f);
+	Gravity = Vector2r(0.0f, -3.0f);
 	K = 1000.0f;
 	Stand_Density = 1000.0f;
 	Time_Delta = 0.002f;
+	Adaptive_Time = false;
+	Min_Time_Delta = 0.0001f;
+	Max_Time_Delta = 0.01f;
+	CFL_Number = 0.4f;
+	Simulation_Time = 0.0;
+
+	Solver = SOLVER_WCSPH;
+	Solver_Tolerance = 0.01f;
+	Min_Solver_Iterations = 2;
+	Max_Solver_Iterations = 100;
+	Solver_Iterations = 0;
+	Total_Solver_Iterations = 0;
+	Density_Error = 0.0f;
+	Pair_Start = NULL;
+	Pair_Index = NULL;
+	Pair_Grad_x = NULL;
+	Pair_Grad_y = NULL;
+	Pair_Capacity = 0;
 	Wall_Hit = 0.0f;
 	Viscosity_Constant = 8.0f;
+	Use_Boundary = true;
+	Boundary_Valid = false;
+	Boundary_Subdivide = 4;
+	Boundary_Grad_x = NULL;
+	Boundary_Grad_y = NULL;
 
-	Particles = (Particle *)malloc(sizeof(Particle) * Max_Number_Paticles);
-	Cells = (Cell *)malloc(sizeof(Cell) * Number_Cells);
+	Particle_View = NULL;
+	Cells = NULL;
+	Cell_Count = NULL;
+	Grid_Slot = NULL;
+	Grid_Index = NULL;
+	Handle_Index = NULL;
+	Cell_Rank = NULL;
+	Sort_Keys = NULL;
+	Sort_Index = NULL;
+	Cell_Order = CURVE_HILBERT;
+	Init_Grid();
+	Reorder_Interval = 100;
+	Next_Reorder = 0;
+	Step_Count = 0;
 
-	CONSTANT1 = 315.0f/(64.0f * PI * pow(kernel, 9));
-	CONSTANT2 = 45.0f/(PI * pow(kernel, 6));
+	Use_Neighbor_List = false;
+	Skin = kernel * 0.3f;
+	Neighbor_List_Valid = false;
+	Neighbor_Builds = 0;
+	Neighbor_Steps = 0;
+	Neighbor_Capacity = 0;
+	Neighbor_Start = NULL;
+	Neighbor_Index = NULL;
+	List_Pos_x = NULL;
+	List_Pos_y = NULL;
+
+	Use_Symmetric_Force = false;
+	Kernels = Get_SIMD_Kernels(Detect_SIMD_Level());
+	Force_Buffer = NULL;
+	Force_Buffer_Threads = 0;
+
+	Buffers = NULL;
+	Block_Sum = NULL;
+	Profile_Interval = 0;
+	Set_Thread_Number(0);
+	Reserve(1024);
+
+	Update_Kernel_Constants();
 
 	cout<<"SPHSystem"<<endl;
 	cout<<"Grid_Size_X : "<<Grid_Size.x<<endl;
@@ -45,40 +137,130 @@ SPH::SPH(){
 }
 
 SPH::~SPH(){
-	free(Particles);
+	Particles.Free();
+	Sorted_Particles.Free();
+	Delete_Particle_View(Particle_View, Max_Number_Paticles);
+	free(Cells);
+	delete[] Cell_Count;
+	Aligned_Free(Grid_Slot);
+	Aligned_Free(Grid_Index);
+	Aligned_Free(Handle_Index);
+	delete[] Buffers;
+	free(Block_Sum);
+	free(Cell_Rank);
+	Aligned_Free(Sort_Keys);
+	Aligned_Free(Sort_Index);
+	Aligned_Free(Neighbor_Start);
+	free(Neighbor_Index);
+	Aligned_Free(List_Pos_x);
+	Aligned_Free(List_Pos_y);
+	Aligned_Free(Force_Buffer);
+	Solver_Data.Free();
+	Aligned_Free(Pair_Start);
+	Aligned_Free(Pair_Index);
+	Aligned_Free(Pair_Grad_x);
+	Aligned_Free(Pair_Grad_y);
+	Aligned_Free(Boundary_Grad_x);
+	Aligned_Free(Boundary_Grad_y);
+}
+
+// cells of Cell_Size covering World_Size, the grid arrays are allocated again
+void SPH::Init_Grid(){
+	Grid_Size = World_Size / Cell_Size;
+	Grid_Size.x = (int)Grid_Size.x;
+	Grid_Size.y = (int)Grid_Size.y;
+	Number_Cells = (int)Grid_Size.x * (int)Grid_Size.y;
+
 	free(Cells);
+	Cells = (Cell *)malloc(sizeof(Cell) * Number_Cells);
+	delete[] Cell_Count;
+	Cell_Count = new atomic<int>[Number_Cells];
+	free(Cell_Rank);
+	Cell_Rank = (int *)malloc(sizeof(int) * Number_Cells);
+	Set_Cell_Order(Cell_Order);
 }
 
 void SPH::Init_Fluid(){
-	Vector2 pos;
-	Vector2 vel(0.0f, 0.0f);
+	Init_Block(Vector2r(World_Size.x * 0.3f, World_Size.y * 0.3f),
+	           Vector2r(World_Size.x * 0.7f, World_Size.y * 0.9f), kernel * 0.6f);
+	cout<<"Number of Paticles : "<<Number_Particles<<endl;
+}
 
-	for(float i = World_Size.x * 0.3f; i < World_Size.x * 0.7f; i += kernel * 0.6f)
-		for(float j = World_Size.y * 0.3f; j < World_Size.y * 0.9f; j += kernel * 0.6f){
-			pos = Vector2(i, j);
-			Init_Particle(pos, vel);
+// particles on a regular lattice from lower up to but not including upper, at rest,
+// without the places within half a spacing of an obstacle
+void SPH::Init_Block(Vector2r lower, Vector2r upper, Real spacing){
+	Vector2r pos;
+	Vector2r vel(0.0f, 0.0f);
+
+	for(Real i = lower.x; i < upper.x; i += spacing)
+		for(Real j = lower.y; j < upper.y; j += spacing){
+			pos = Vector2r(i, j);
+			bool blocked = false;
+			static bool skipw = getenv("PSKIPW") != NULL;
+			if(skipw && Use_Boundary)
+				blocked = min(min(pos.x, World_Size.x - pos.x), min(pos.y, World_Size.y - pos.y)) < 0.5f * spacing;
+			for(size_t o = 0; (o < Obstacles.size())&&!blocked; o++)
+				blocked = Obstacles[o].Distance(pos) < 0.5f * spacing;
+			if(!blocked)
+				Init_Particle(pos, vel);
 		}
-	cout<<"Number of Paticles : "<<Number_Particles<<endl;
 }
 
-void SPH::Init_Particle(Vector2 pos, Vector2 vel){
-	Particle *p = &(Particles[Number_Particles]);
-	p->pos = pos;
-	p->vel = vel;
-	p->acc = Vector2(0.0f, 0.0f);
-	p->dens = Stand_Density;
-	p->next = NULL;
+// grow all per particle arrays to capacity particles, the particles are kept
+void SPH::Reserve(int capacity){
+	if(capacity <= Max_Number_Paticles)
+		return;
+	Particles.Reserve(capacity, Number_Particles);
+	Sorted_Particles.Reserve(capacity, 0);
+	Aligned_Grow(Handle_Index, Number_Particles, capacity);
+	Delete_Particle_View(Particle_View, Max_Number_Paticles);
+	Particle_View = New_Particle_View(capacity);
+	Aligned_Grow(Grid_Slot, 0, capacity);
+	Aligned_Grow(Grid_Index, 0, capacity);
+	Aligned_Grow(Sort_Keys, 0, capacity * 2);
+	Aligned_Grow(Sort_Index, 0, capacity * 2);
+	Aligned_Grow(Neighbor_Start, 0, capacity + 1);
+	Aligned_Grow(List_Pos_x, 0, capacity);
+	Aligned_Grow(List_Pos_y, 0, capacity);
+	Solver_Data.Reserve(capacity);
+	Aligned_Grow(Pair_Start, 0, capacity + 1);
+	Aligned_Grow(Boundary_Grad_x, 0, capacity);
+	Aligned_Grow(Boundary_Grad_y, 0, capacity);
+	Aligned_Free(Force_Buffer);
+	Force_Buffer = NULL;
+	Force_Buffer_Threads = 0;
+	Neighbor_List_Valid = false;
+	Max_Number_Paticles = capacity;
+}
+
+Particle_Handle SPH::Init_Particle(Vector2r pos, Vector2r vel){
+	if(Number_Particles == Max_Number_Paticles)
+		Reserve(Max_Number_Paticles * 2);		// doubling, so adding n particles is O(n)
+	int i = Number_Particles;
+	Particles.pos_x[i] = pos.x;
+	Particles.pos_y[i] = pos.y;
+	Particles.vel_x[i] = vel.x;
+	Particles.vel_y[i] = vel.y;
+	Particles.acc_x[i] = 0.0f;
+	Particles.acc_y[i] = 0.0f;
+	Particles.dens[i] = Stand_Density;
+	Particles.pres[i] = 0.0f;
+	Particles.cell[i] = -1;
+	Particles.id[i] = i;		// handles are never reused, particles are only added
+	Handle_Index[i] = i;
 	Number_Particles++;
+	Neighbor_List_Valid = false;
+	return i;
 }
 
-Vector2 SPH::Calculate_Cell_Position(Vector2 pos){
-	Vector2 cellpos = pos / Cell_Size;
+Vector2r SPH::Calculate_Cell_Position(Vector2r pos){
+	Vector2r cellpos = pos / Cell_Size;
 	cellpos.x = (int)cellpos.x;
 	cellpos.y = (int)cellpos.y;
 	return cellpos;
 }
 
-int SPH::Calculate_Cell_Hash(Vector2 pos){
+int SPH::Calculate_Cell_Hash(Vector2r pos){
 	if((pos.x < 0)||(pos.x >= Grid_Size.x)||(pos.y < 0)||(pos.y >= Grid_Size.y)){
 		return -1;
 	}
@@ -86,158 +268,861 @@ int SPH::Calculate_Cell_Hash(Vector2 pos){
 	if(hash > Number_Cells){
 		cout<<"Error";
 	}
-	return hash;
+	return Cell_Rank[hash];
 }
 
-float SPH::Poly6(float r2){
-	return CONSTANT1 * pow(kernel * kernel - r2, 3);
+Real SPH::Poly6(Real r2){
+	return Kernel_Poly6(Constants, r2);
 }
 
-float SPH::Spiky(float r){
-	return -CONSTANT2 * (kernel - r)* (kernel - r);
+Real SPH::Spiky(Real r){
+	return Kernel_Spiky(Constants, r);
 }
 
-float SPH::Visco(float r){
-	return CONSTANT2 * (kernel - r);
+Real SPH::Visco(Real r){
+	return Kernel_Visco(Constants, r);
 }
 
+// counting sort of the particles by cell, every cell becomes a contiguous range
 void SPH::Hash_Grid(){
-	for(int i = 0; i < Number_Cells; i++)
-		Cells[i].head = NULL;
-	int hash;
-	Particle *p;
-	for(int i = 0; i < Number_Particles; i ++){
-		p = &Particles[i];
-		hash = Calculate_Cell_Hash(Calculate_Cell_Position(p->pos));
-		if(Cells[hash].head == NULL){
-			p->next = NULL;
-			Cells[hash].head = p;
+	PROFILE_SCOPE(Timing, PHASE_GRID);
+	#pragma omp parallel num_threads(Number_Threads)
+	{
+		// count particles per cell, the slot of a particle is its place inside the cell
+		#pragma omp for
+		for(int i = 0; i < Number_Cells; i++)
+			Cell_Count[i].store(0, memory_order_relaxed);
+		#pragma omp for
+		for(int i = 0; i < Number_Particles; i ++){
+			int hash = Calculate_Cell_Hash(Calculate_Cell_Position(Vector2r(Particles.pos_x[i], Particles.pos_y[i])));
+			Particles.cell[i] = hash;
+			Grid_Slot[i] = Cell_Count[hash].fetch_add(1, memory_order_relaxed);
 		}
-		else{
-			p->next = Cells[hash].head;
-			Cells[hash].head = p;
+
+		// prefix sum, every thread sums a block of cells, then adds the sum of the blocks before it
+		int t = Thread_Id();
+		int threads = Team_Size();
+		int begin = (int)((long long)Number_Cells * t / threads);
+		int end = (int)((long long)Number_Cells * (t + 1) / threads);
+		int sum = 0;
+		for(int i = begin; i < end; i++)
+			sum += Cell_Count[i].load(memory_order_relaxed);
+		Block_Sum[t + 1] = sum;
+		#pragma omp barrier
+		#pragma omp single
+		{
+			Block_Sum[0] = 0;
+			for(int i = 1; i <= threads; i++)
+				Block_Sum[i] += Block_Sum[i - 1];
+		}
+		sum = Block_Sum[t];
+		for(int i = begin; i < end; i++){
+			Cells[i].start = sum;
+			sum += Cell_Count[i].load(memory_order_relaxed);
+			Cells[i].end = sum;
+		}
+		#pragma omp barrier
+
+		#pragma omp for
+		for(int i = 0; i < Number_Particles; i++)
+			Grid_Index[Cells[Particles.cell[i]].start + Grid_Slot[i]] = i;
+
+		// with several threads the slots are handed out in any order,
+		// sort the few particles of each cell back into particle order to keep the sort stable
+		if(threads > 1){
+			#pragma omp for schedule(dynamic, 256)
+			for(int c = 0; c < Number_Cells; c++)
+				for(int i = Cells[c].start + 1; i < Cells[c].end; i++){
+					int index = Grid_Index[i];
+					int j = i - 1;
+					for(; (j >= Cells[c].start)&&(Grid_Index[j] > index); j--)
+						Grid_Index[j + 1] = Grid_Index[j];
+					Grid_Index[j + 1] = index;
+				}
+		}
+
+		#pragma omp for
+		for(int d = 0; d < Number_Particles; d++){
+			Sorted_Particles.Copy(d, Particles, Grid_Index[d]);
+			Handle_Index[Sorted_Particles.id[d]] = d;
+		}
+	}
+	swap(Particles, Sorted_Particles);
+}
+
+// radix sort of the particles by cell and by a Morton key inside the cell,
+// Hash_Grid is stable so the order inside the cells lasts until the next reorder
+void SPH::Reorder_Particles(){
+	PROFILE_SCOPE(Timing, PHASE_REORDER);
+	const int sub = 16;				// sub cells per cell side, 4 bits per axis
+	#pragma omp parallel for num_threads(Number_Threads)
+	for(int i = 0; i < Number_Particles; i++){
+		Real cx = Particles.pos_x[i] / Cell_Size;
+		Real cy = Particles.pos_y[i] / Cell_Size;
+		int hash = Calculate_Cell_Hash(Vector2r((int)cx, (int)cy));
+		int sx = (int)((cx - (int)cx) * sub);
+		int sy = (int)((cy - (int)cy) * sub);
+		if(sx > sub - 1) sx = sub - 1;
+		if(sy > sub - 1) sy = sub - 1;
+		Sort_Keys[i] = ((unsigned int)hash << 8) | Morton_Encode(sx, sy);
+		Sort_Index[i] = i;
+	}
+	unsigned int max_key = (unsigned int)Number_Cells << 8;
+	Radix_Sort(Sort_Keys, Sort_Index, Number_Particles,
+	           Sort_Keys + Max_Number_Paticles, Sort_Index + Max_Number_Paticles, max_key);
+	#pragma omp parallel for num_threads(Number_Threads)
+	for(int i = 0; i < Number_Particles; i++){
+		Sorted_Particles.Copy(i, Particles, Sort_Index[i]);
+		Handle_Index[Sorted_Particles.id[i]] = i;
+	}
+	swap(Particles, Sorted_Particles);
+}
+
+// copy the particles of the 3x3 cells around cell (x, y) into b,
+// velocity, density and pressure only when they are needed for the force,
+// returns the number of particles without the padding
+int SPH::Gather_Cells(int x, int y, bool all_fields, Neighbor_Buffer &b){
+	b.count = 0;
+	for(int i = -1; i <= 1; i++)
+		for(int j = -1; j <= 1; j++){
+			int hash = Calculate_Cell_Hash(Vector2r(x + i, y + j));
+			if(hash == -1)
+				continue;
+			int start = Cells[hash].start;
+			int size = Cells[hash].end - start;
+			b.Reserve(b.count + size);
+			memcpy(b.pos_x + b.count, Particles.pos_x + start, sizeof(Real) * size);
+			memcpy(b.pos_y + b.count, Particles.pos_y + start, sizeof(Real) * size);
+			if(all_fields){
+				memcpy(b.vel_x + b.count, Particles.vel_x + start, sizeof(Real) * size);
+				memcpy(b.vel_y + b.count, Particles.vel_y + start, sizeof(Real) * size);
+				memcpy(b.dens + b.count, Particles.dens + start, sizeof(Real) * size);
+				memcpy(b.pres + b.count, Particles.pres + start, sizeof(Real) * size);
+			}
+			b.count += size;
+		}
+	int count = b.count;
+	b.Pad();
+	return count;
+}
+
+// copy the neighbor list of particle k into b, returns the number of neighbors
+int SPH::Gather_List(int k, bool all_fields, Neighbor_Buffer &b){
+	int start = Neighbor_Start[k];
+	int size = Neighbor_Start[k + 1] - start;
+	b.Reserve(size);
+	for(int m = 0; m < size; m++){
+		int n = Neighbor_Index[start + m];
+		b.pos_x[m] = Particles.pos_x[n];
+		b.pos_y[m] = Particles.pos_y[n];
+		if(all_fields){
+			b.vel_x[m] = Particles.vel_x[n];
+			b.vel_y[m] = Particles.vel_y[n];
+			b.dens[m] = Particles.dens[n];
+			b.pres[m] = Particles.pres[n];
 		}
 	}
+	b.count = size;
+	b.Pad();
+	return size;
+}
+
+void SPH::Set_Density(int k, Real dens){
+	dens += mass * Constants.poly6 * Constants.kernel6;		// the particle itself, Poly6(0)
+	if(Use_Boundary){
+		Real wall = 0.0f;
+		Real gx = 0.0f;
+		Real gy = 0.0f;
+		Boundary.Sample(Particles.pos_x[k], Particles.pos_y[k], wall, gx, gy);
+		dens += wall;
+		Boundary_Grad_x[k] = gx;
+		Boundary_Grad_y[k] = gy;
+	}
+	Particles.dens[k] = dens;
+	Particles.pres[k] = Tait_Pressure(dens, Stand_Density, K);
 }
 
+void SPH::Set_Force(int k, Real ax, Real ay){
+	if(Use_Boundary){
+		// the walls are fluid at rest with the pressure of k, they push but never pull
+		Real push = max(Particles.pres[k], (Real)0.0f) / Stand_Density;
+		ax -= push * Boundary_Grad_x[k];
+		ay -= push * Boundary_Grad_y[k];
+	}
+	Particles.acc_x[k] = ax / Particles.dens[k] + Gravity.x;
+	Particles.acc_y[k] = ay / Particles.dens[k] + Gravity.y;
+}
+
+// the particles of a cell share the same 3x3 neighbor cells, so they are gathered once per cell,
+// every particle only writes its own density, so the threads never write to the same place
 void SPH::Comupte_Density_SingPressure(){
-	Particle *p;
-	Particle *np;
-	Vector2 CellPos;
-	Vector2 NeighborPos;
-	int hash;
-	for(int k = 0; k < Number_Particles; k++){
-		p = &Particles[k];
-		p->dens = 0;
-		p->pres = 0;
-		CellPos = Calculate_Cell_Position(p->pos);
-		for(int i = -1; i <= 1; i++)
-			for(int j = -1; j <= 1; j++){
-				NeighborPos = CellPos + Vector2(i, j);
-				hash = Calculate_Cell_Hash(NeighborPos);
-				if(hash == -1)
-					continue;
-				np = Cells[hash].head;
-				while(np != NULL){
-					Vector2 Distance;
-					Distance = p->pos - np->pos;
-					float dis2 = (float)Distance.getNormSquared();
-
-					if((dis2 < INF)||(dis2 > kernel * kernel)){
-						np = np->next;
+	PROFILE_SCOPE(Timing, PHASE_DENSITY);
+	if(Use_Boundary&&!Boundary_Valid)
+		Bake_Boundary();
+	int grid_x = (int)Grid_Size.x;
+	int grid_y = (int)Grid_Size.y;
+	long long pairs = 0;			// neighbor candidates examined, for the profiler
+	#pragma omp parallel num_threads(Number_Threads)
+	{
+		Neighbor_Buffer &b = Buffers[Thread_Id()];
+		if(Use_Neighbor_List){
+			#pragma omp for schedule(dynamic, 256) reduction(+:pairs)
+			for(int k = 0; k < Number_Particles; k++){
+				pairs += Gather_List(k, false, b);
+				Set_Density(k, Kernels.density(Constants, Particles.pos_x[k], Particles.pos_y[k], b));
+			}
+		}
+		else{
+			#pragma omp for schedule(dynamic, 1) reduction(+:pairs)
+			for(int y = 0; y < grid_y; y++)
+				for(int x = 0; x < grid_x; x++){
+					Cell c = Cells[Calculate_Cell_Hash(Vector2r(x, y))];
+					if(c.start == c.end)
 						continue;
-					}
-					p->dens += mass * Poly6(dis2);
-					np = np->next;
+					pairs += (long long)(Gather_Cells(x, y, false, b) - 1) * (c.end - c.start);		// without the particle itself
+					for(int k = c.start; k < c.end; k++)
+						Set_Density(k, Kernels.density(Constants, Particles.pos_x[k], Particles.pos_y[k], b));
 				}
-			}
-		p->dens += mass * Poly6(0.0f);
-		p->pres = (pow(p->dens / Stand_Density, 7) - 1) * K;
+		}
 	}
+	Timing.Add_Pairs(pairs);
 }
 
 void SPH::Computer_Force(){
-	Particle *p;
-	Particle *np;
-	Vector2 CellPos;
-	Vector2 NeighborPos;
-	int hash;
-	for(int k = 0; k < Number_Particles; k++){
-		p = &Particles[k];
-		p->acc = Vector2(0.0f, 0.0f);
-		CellPos = Calculate_Cell_Position(p->pos);
-		for(int i = -1; i <= 1; i++)
-			for(int j = -1; j <= 1; j++){
-				NeighborPos = CellPos + Vector2(i, j);
-				hash = Calculate_Cell_Hash(NeighborPos);
-				if(hash == -1)
-					continue;
-				np = Cells[hash].head;
-				while(np != NULL){
-					Vector2 Distance;
-					Distance = p->pos - np->pos;
-					float dis2 = (float)Distance.getNormSquared();
-
-					if((dis2 < kernel *kernel)&&(dis2 > INF)){
-						float dis = sqrt(dis2);
-						float Volume = mass / np->dens;
-						float Force = Volume * (p->pres+np->pres)/2 * Spiky(dis);
-						p->acc -= Distance*Force/dis;
-
-						Vector2 RelativeVel = np->vel - p->vel;
-						Force = Volume * Viscosity_Constant * Visco(dis);
-						p->acc += RelativeVel*Force;
+	PROFILE_SCOPE(Timing, PHASE_FORCE);
+	if(Use_Symmetric_Force){
+		Computer_Force_Symmetric();
+		return;
+	}
+	int grid_x = (int)Grid_Size.x;
+	int grid_y = (int)Grid_Size.y;
+	#pragma omp parallel num_threads(Number_Threads)
+	{
+		Neighbor_Buffer &b = Buffers[Thread_Id()];
+		Real ax;
+		Real ay;
+		if(Use_Neighbor_List){
+			#pragma omp for schedule(dynamic, 256)
+			for(int k = 0; k < Number_Particles; k++){
+				Gather_List(k, true, b);
+				ax = 0.0f;
+				ay = 0.0f;
+				Kernels.force(Constants, Particles.pos_x[k], Particles.pos_y[k], Particles.vel_x[k], Particles.vel_y[k],
+				              Particles.pres[k], b, ax, ay);
+				Set_Force(k, ax, ay);
+			}
+		}
+		else{
+			#pragma omp for schedule(dynamic, 1)
+			for(int y = 0; y < grid_y; y++)
+				for(int x = 0; x < grid_x; x++){
+					Cell c = Cells[Calculate_Cell_Hash(Vector2r(x, y))];
+					if(c.start == c.end)
+						continue;
+					Gather_Cells(x, y, true, b);
+					for(int k = c.start; k < c.end; k++){
+						ax = 0.0f;
+						ay = 0.0f;
+						Kernels.force(Constants, Particles.pos_x[k], Particles.pos_y[k], Particles.vel_x[k], Particles.vel_y[k],
+						              Particles.pres[k], b, ax, ay);
+						Set_Force(k, ax, ay);
+					}
+				}
+		}
+	}
+}
+
+// force between particles a and b, added to a and subtracted from b,
+// the 1 / dens[a] of the gather form is folded in so both sides are equal and opposite
+void SPH::Pair_Force(int a, int b, Real *acc_x, Real *acc_y){
+	const Real *dens = Particles.dens;
+	const Real *pres = Particles.pres;
+	Real dx = Particles.pos_x[a] - Particles.pos_x[b];
+	Real dy = Particles.pos_y[a] - Particles.pos_y[b];
+	Real dis2 = dx * dx + dy * dy;
+
+	if((dis2 < Constants.kernel2)&&(dis2 > INF)){
+		Real dis = sqrt(dis2);
+		Real Volume = mass / (dens[a] * dens[b]);
+		Real Pressure = Volume * (pres[a] + pres[b])/2 * Spiky(dis) / dis;
+		Real Viscous = Volume * Viscosity_Constant * Visco(dis);
+		Real fx = (Particles.vel_x[b] - Particles.vel_x[a]) * Viscous - dx * Pressure;
+		Real fy = (Particles.vel_y[b] - Particles.vel_y[a]) * Viscous - dy * Pressure;
+		acc_x[a] += fx;
+		acc_y[a] += fy;
+		acc_x[b] -= fx;
+		acc_y[b] -= fy;
+	}
+}
+
+// every pair is evaluated once: inside a cell, and with the cells to the right and above
+// (half stencil), or only with the list neighbors of higher index. Every thread scatters
+// into its own acceleration buffers, which are summed at the end, so there are no races.
+void SPH::Computer_Force_Symmetric(){
+	int threads = Number_Threads;
+	if(threads > Force_Buffer_Threads){
+		Aligned_Free(Force_Buffer);
+		Force_Buffer = (Real *)Aligned_Malloc(sizeof(Real) * Max_Number_Paticles * 2 * threads);
+		Force_Buffer_Threads = threads;
+	}
+
+	const int forward[4][2] = {{1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+	int grid_x = (int)Grid_Size.x;
+	int grid_y = (int)Grid_Size.y;
+
+	#pragma omp parallel num_threads(threads)
+	{
+		int t = Thread_Id();
+		int team = Team_Size();			// may be less than threads, only these buffers are zeroed and summed
+		Real *ax = Force_Buffer + (size_t)Max_Number_Paticles * 2 * t;
+		Real *ay = ax + Max_Number_Paticles;
+		memset(ax, 0, sizeof(Real) * Number_Particles);
+		memset(ay, 0, sizeof(Real) * Number_Particles);
+
+		if(Use_Neighbor_List){
+			#pragma omp for schedule(dynamic, 256)
+			for(int k = 0; k < Number_Particles; k++)
+				for(int m = Neighbor_Start[k]; m < Neighbor_Start[k + 1]; m++){
+					int n = Neighbor_Index[m];
+					if(n > k)
+						Pair_Force(k, n, ax, ay);
+				}
+		}
+		else{
+			#pragma omp for schedule(dynamic, 1)
+			for(int y = 0; y < grid_y; y++)
+				for(int x = 0; x < grid_x; x++){
+					Cell c = Cells[Calculate_Cell_Hash(Vector2r(x, y))];
+					for(int a = c.start; a < c.end; a++)
+						for(int b = a + 1; b < c.end; b++)
+							Pair_Force(a, b, ax, ay);
+					for(int f = 0; f < 4; f++){
+						int hash = Calculate_Cell_Hash(Vector2r(x + forward[f][0], y + forward[f][1]));
+						if(hash == -1)
+							continue;
+						for(int a = c.start; a < c.end; a++)
+							for(int b = Cells[hash].start; b < Cells[hash].end; b++)
+								Pair_Force(a, b, ax, ay);
 					}
-					np = np->next;
 				}
+		}
+
+		#pragma omp for
+		for(int k = 0; k < Number_Particles; k++){
+			Real sum_x = 0.0f;
+			Real sum_y = 0.0f;
+			for(int i = 0; i < team; i++){
+				sum_x += Force_Buffer[(size_t)Max_Number_Paticles * 2 * i + k];
+				sum_y += Force_Buffer[(size_t)Max_Number_Paticles * (2 * i + 1) + k];
+			}
+			if(Use_Boundary){
+				Real push = max(Particles.pres[k], (Real)0.0f) / (Stand_Density * Particles.dens[k]);
+				sum_x -= push * Boundary_Grad_x[k];
+				sum_y -= push * Boundary_Grad_y[k];
+			}
+			Particles.acc_x[k] = sum_x + Gravity.x;
+			Particles.acc_y[k] = sum_y + Gravity.y;
+		}
+	}
+}
+
+// neighbors of particle k within kernel + Skin written to out, or only counted if out is NULL
+int SPH::Search_Neighbors(int k, int *out){
+	const Real *pos_x = Particles.pos_x;
+	const Real *pos_y = Particles.pos_y;
+	Real radius2 = (kernel + Skin) * (kernel + Skin);
+	int reach = (int)ceil((kernel + Skin) / Cell_Size);		// cells to search on each side
+	Real px = pos_x[k];
+	Real py = pos_y[k];
+	Vector2r CellPos = Calculate_Cell_Position(Vector2r(px, py));
+	int count = 0;
+	for(int i = -reach; i <= reach; i++)
+		for(int j = -reach; j <= reach; j++){
+			int hash = Calculate_Cell_Hash(CellPos + Vector2r(i, j));
+			if(hash == -1)
+				continue;
+			for(int n = Cells[hash].start; n < Cells[hash].end; n++){
+				Real dx = px - pos_x[n];
+				Real dy = py - pos_y[n];
+				if((n == k)||(dx * dx + dy * dy > radius2))
+					continue;
+				if(out != NULL)
+					out[count] = n;
+				count++;
 			}
-		p->acc = p->acc/p->dens + Gravity;
+		}
+	return count;
+}
+
+// particles within kernel + Skin of each particle, in compressed rows:
+// the neighbors of i are Neighbor_Index[Neighbor_Start[i] .. Neighbor_Start[i + 1]),
+// built in two passes, count and then fill, so every thread knows where to write
+void SPH::Build_Neighbor_List(){
+	PROFILE_SCOPE(Timing, PHASE_NEIGHBOR_LIST);
+	#pragma omp parallel for num_threads(Number_Threads) schedule(dynamic, 256)
+	for(int k = 0; k < Number_Particles; k++)
+		Neighbor_Start[k + 1] = Search_Neighbors(k, NULL);
+
+	Neighbor_Start[0] = 0;
+	for(int k = 0; k < Number_Particles; k++)
+		Neighbor_Start[k + 1] += Neighbor_Start[k];
+	int count = Neighbor_Start[Number_Particles];
+	if(count > Neighbor_Capacity){
+		if(Neighbor_Capacity == 0)
+			Neighbor_Capacity = 1024;
+		while(count > Neighbor_Capacity)
+			Neighbor_Capacity *= 2;
+		free(Neighbor_Index);
+		Neighbor_Index = (int *)malloc(sizeof(int) * Neighbor_Capacity);
+	}
+
+	#pragma omp parallel for num_threads(Number_Threads) schedule(dynamic, 256)
+	for(int k = 0; k < Number_Particles; k++){
+		Search_Neighbors(k, Neighbor_Index + Neighbor_Start[k]);
+		List_Pos_x[k] = Particles.pos_x[k];
+		List_Pos_y[k] = Particles.pos_y[k];
 	}
+	Neighbor_List_Valid = true;
+	Neighbor_Builds++;
+}
+
+// pairs within the kernel and their kernel gradients for the iterative solvers,
+// which visit every pair many times in a step, built like the neighbor list,
+// with a margin the pairs within kernel + margin, the gradient is 0 beyond the kernel
+void SPH::Build_Solver_Pairs(Real margin){
+	Real radius = kernel + margin;
+	#pragma omp parallel for num_threads(Number_Threads) schedule(dynamic, 256)
+	for(int i = 0; i < Number_Particles; i++){
+		int count = 0;
+		if(margin > 0.0f)
+			For_Each_Within(i, radius, [&](int, Real, Real, Real){ count++; });
+		else
+			For_Each_Neighbor(i, [&](int, Real, Real, Real){ count++; });
+		Pair_Start[i + 1] = count;
+	}
+
+	Pair_Start[0] = 0;
+	for(int i = 0; i < Number_Particles; i++)
+		Pair_Start[i + 1] += Pair_Start[i];
+	int count = Pair_Start[Number_Particles];
+	if(count > Pair_Capacity){
+		if(Pair_Capacity == 0)
+			Pair_Capacity = 1024;
+		while(count > Pair_Capacity)
+			Pair_Capacity *= 2;
+		Aligned_Grow(Pair_Index, 0, Pair_Capacity);
+		Aligned_Grow(Pair_Grad_x, 0, Pair_Capacity);
+		Aligned_Grow(Pair_Grad_y, 0, Pair_Capacity);
+	}
+
+	#pragma omp parallel for num_threads(Number_Threads) schedule(dynamic, 256)
+	for(int i = 0; i < Number_Particles; i++){
+		int m = Pair_Start[i];
+		auto store = [&](int j, Real dx, Real dy, Real dis){
+			Real g = dis < kernel ? Kernel_Spiky(Constants, dis) / dis : 0.0f;
+			Pair_Index[m] = j;
+			Pair_Grad_x[m] = g * dx;
+			Pair_Grad_y[m] = g * dy;
+			m++;
+		};
+		if(margin > 0.0f)
+			For_Each_Within(i, radius, store);
+		else
+			For_Each_Neighbor(i, store);
+	}
+}
+
+// the list holds every pair within kernel until a particle moved more than half the skin
+bool SPH::Neighbor_List_Expired(){
+	PROFILE_SCOPE(Timing, PHASE_NEIGHBOR_LIST);
+	if(!Neighbor_List_Valid)
+		return true;
+	Real limit2 = Skin * Skin * 0.25f;
+	int moved = 0;
+	#pragma omp parallel for num_threads(Number_Threads) reduction(+:moved)
+	for(int i = 0; i < Number_Particles; i++){
+		Real dx = Particles.pos_x[i] - List_Pos_x[i];
+		Real dy = Particles.pos_y[i] - List_Pos_y[i];
+		if(dx * dx + dy * dy > limit2)
+			moved++;
+	}
+	return moved > 0;
+}
+
+// largest stable step for the current velocities and accelerations:
+// a sound wave and the fastest particle may travel CFL_Number kernels (CFL condition),
+// the acceleration may move a particle a quarter kernel (force condition),
+// and the viscosity may diffuse an eighth of a kernel squared (viscous condition),
+// an incompressible fluid has no sound waves, so only the particles count
+Real SPH::Compute_Time_Delta(bool compressible){
+	Real max_vel2 = 0.0f;
+	Real max_acc2 = 0.0f;
+	#pragma omp parallel num_threads(Number_Threads)
+	{
+		Real vel2 = 0.0f;
+		Real acc2 = 0.0f;
+		#pragma omp for
+		for(int i = 0; i < Number_Particles; i++){
+			vel2 = max(vel2, Particles.vel_x[i] * Particles.vel_x[i] + Particles.vel_y[i] * Particles.vel_y[i]);
+			acc2 = max(acc2, Particles.acc_x[i] * Particles.acc_x[i] + Particles.acc_y[i] * Particles.acc_y[i]);
+		}
+		#pragma omp critical
+		{
+			max_vel2 = max(max_vel2, vel2);
+			max_acc2 = max(max_acc2, acc2);
+		}
+	}
+
+	// speed of sound of the Tait equation, c^2 = dp/drho at the rest density = 7 K / p0
+	Real sound = compressible ? sqrt(7.0f * K / Stand_Density) : 0.0f;
+	Real speed = sound + sqrt(max_vel2);
+	Real dt = speed > 0.0f ? CFL_Number * kernel / speed : Max_Time_Delta;
+	Real max_acc = sqrt(max_acc2);
+	if(max_acc > 0.0f)
+		dt = min(dt, (Real)0.25f * sqrt(kernel / max_acc));
+	Real nu = Viscosity_Constant / Stand_Density;		// kinematic viscosity
+	if(nu > 0.0f)
+		dt = min(dt, (Real)0.125f * kernel * kernel / nu);
+	return min(max(dt, Min_Time_Delta), Max_Time_Delta);
 }
 
 void SPH::Update_Pos_Vel(){
-	Particle *p;
+	PROFILE_SCOPE(Timing, PHASE_UPDATE);
+	if(Use_Boundary&&!Boundary_Valid)
+		Bake_Boundary();
+	Real *pos_x = Particles.pos_x;
+	Real *pos_y = Particles.pos_y;
+	Real *vel_x = Particles.vel_x;
+	Real *vel_y = Particles.vel_y;
+	#pragma omp parallel for num_threads(Number_Threads)
 	for(int i=0; i < Number_Particles; i++){
-		p = &Particles[i];
-		p->vel = p->vel + p->acc*Time_Delta;
-		p->pos = p->pos + p->vel*Time_Delta;
+		vel_x[i] = vel_x[i] + Particles.acc_x[i]*Time_Delta;
+		vel_y[i] = vel_y[i] + Particles.acc_y[i]*Time_Delta;
+		pos_x[i] = pos_x[i] + vel_x[i]*Time_Delta;
+		pos_y[i] = pos_y[i] + vel_y[i]*Time_Delta;
 
-		if(p->pos.x < 0.0f){
-			p->vel.x = p->vel.x * Wall_Hit;
-			p->pos.x = 0.0f;
+		// the walls push before a particle reaches them, one that still got in goes back to the
+		// surface and keeps Wall_Hit of its speed into the wall, the clamping below is the last resort
+		if(Use_Boundary){
+			Real d = Boundary.Distance(pos_x[i], pos_y[i]);
+			if(d < 0.0f){
+				Vector2r n = Boundary.Distance_Gradient(pos_x[i], pos_y[i]);
+				Real length = sqrt(n.x * n.x + n.y * n.y);
+				if(length > INF){
+					n = n / length;
+					pos_x[i] -= d * n.x;
+					pos_y[i] -= d * n.y;
+					Real into = vel_x[i] * n.x + vel_y[i] * n.y;
+					if(into < 0.0f){
+						vel_x[i] += (Wall_Hit - 1.0f) * into * n.x;
+						vel_y[i] += (Wall_Hit - 1.0f) * into * n.y;
+					}
+				}
+			}
 		}
-		if(p->pos.x >= World_Size.x){
-			p->vel.x = p->vel.x * Wall_Hit;
-			p->pos.x = World_Size.x - 0.0001f;
+		if(pos_x[i] < 0.0f){
+			vel_x[i] = vel_x[i] * Wall_Hit;
+			pos_x[i] = 0.0f;
 		}
-		if(p->pos.y < 0.0f){
-			p->vel.y = p->vel.y * Wall_Hit;
-			p->pos.y = 0.0f;
+		if(pos_x[i] >= World_Size.x){
+			vel_x[i] = vel_x[i] * Wall_Hit;
+			pos_x[i] = World_Size.x - 0.0001f;
 		}
-		if(p->pos.y >= World_Size.y){
-			p->vel.y = p->vel.y * Wall_Hit;
-			p->pos.y = World_Size.y - 0.0001f;
+		if(pos_y[i] < 0.0f){
+			vel_y[i] = vel_y[i] * Wall_Hit;
+			pos_y[i] = 0.0f;
+		}
+		if(pos_y[i] >= World_Size.y){
+			vel_y[i] = vel_y[i] * Wall_Hit;
+			pos_y[i] = World_Size.y - 0.0001f;
 		}
 	}
+	Simulation_Time += Time_Delta;
+}
+
+// the field of the box walls and the obstacles for the current kernel, world and rest density,
+// baked by the first density pass or update that needs it
+void SPH::Bake_Boundary(){
+	Boundary.Init_Box(World_Size, Cell_Size / Boundary_Subdivide, kernel);
+	for(size_t o = 0; o < Obstacles.size(); o++)
+		Boundary.Add_Obstacle(Obstacles[o], Number_Threads);
+	Boundary.Bake(Constants, Stand_Density, Number_Threads);
+	Boundary_Valid = true;
 }
 
 void SPH::Animation(){
-	Hash_Grid();
-	Comupte_Density_SingPressure();
-	Computer_Force();
-	Update_Pos_Vel();
+	{
+		PROFILE_SCOPE(Timing, PHASE_STEP);
+		// with a neighbor list the particles may only move in memory when the list is rebuilt
+		if((!Use_Neighbor_List)||Neighbor_List_Expired()){
+			if((Reorder_Interval > 0)&&(Step_Count >= Next_Reorder)){
+				Reorder_Particles();
+				Next_Reorder = Step_Count + Reorder_Interval;
+			}
+			Hash_Grid();
+			if(Use_Neighbor_List)
+				Build_Neighbor_List();
+		}
+		if(Use_Neighbor_List)
+			Neighbor_Steps++;
+		switch(Solver){
+		case SOLVER_WCSPH:
+			Comupte_Density_SingPressure();
+			Computer_Force();
+			if(Adaptive_Time)
+				Time_Delta = Compute_Time_Delta(true);
+			break;
+		case SOLVER_IISPH:
+			Solve_IISPH();			// chooses the adaptive time step itself, the solve depends on it
+			break;
+		case SOLVER_PCISPH:
+			Solve_PCISPH();
+			break;
+		}
+		Update_Pos_Vel();
+		Step_Count++;
+	}
+	Timing.End_Step();
+	if((Profile_Interval > 0)&&(Step_Count % Profile_Interval == 0)){
+		printf("step %d\n", Step_Count);
+		Timing.Print(stdout);
+	}
+}
+
+// the cells are as large as the kernel, so the grid changes with it
+void SPH::Set_Kernel(Real h){
+	kernel = h;
+	Cell_Size = kernel;
+	Skin = kernel * 0.3f;
+	Init_Grid();
+	World_Size = Grid_Size * Cell_Size;
+	Update_Kernel_Constants();
+	Boundary_Valid = false;
+}
+
+void SPH::Set_Mass(Real m){
+	mass = m;
+	Update_Kernel_Constants();
+}
+
+// the world is cut to whole cells, so every position inside it has a cell
+void SPH::Set_World_Size(Vector2r size){
+	World_Size = size;
+	Init_Grid();
+	World_Size = Grid_Size * Cell_Size;
+	Boundary_Valid = false;
+}
+
+void SPH::Set_Gravity(Vector2r g){
+	Gravity = g;
+}
+
+void SPH::Set_Stiffness(Real k){
+	K = k;
+}
+
+void SPH::Set_Rest_Density(Real density){
+	Stand_Density = density;
+	Boundary_Valid = false;
+}
+
+void SPH::Set_Viscosity(Real viscosity){
+	Viscosity_Constant = viscosity;
+	Update_Kernel_Constants();
+}
+
+void SPH::Set_Time_Delta(Real dt){
+	Time_Delta = dt;
+}
+
+void SPH::Set_Wall_Hit(Real factor){
+	Wall_Hit = factor;
+}
+
+void SPH::Set_Boundary(bool enable, int subdivide){
+	Use_Boundary = enable;
+	Boundary_Subdivide = max(subdivide, 1);
+	Boundary_Valid = false;
+}
+
+bool SPH::Get_Boundary(){
+	return Use_Boundary;
+}
+
+void SPH::Add_Obstacle(const Obstacle &o){
+	Obstacles.push_back(o);
+	Boundary_Valid = false;
+}
+
+int SPH::Get_Obstacle_Number(){
+	return (int)Obstacles.size();
+}
+
+const Distance_Field& SPH::Get_Boundary_Field(){
+	return Boundary;
+}
+
+// the step is chosen between min_dt and max_dt, without it Time_Delta stays fixed
+void SPH::Set_Adaptive_Time_Step(bool enable, Real min_dt, Real max_dt){
+	Adaptive_Time = enable;
+	Min_Time_Delta = min_dt;
+	Max_Time_Delta = max_dt;
+}
+
+void SPH::Set_CFL_Number(Real cfl){
+	CFL_Number = cfl;
+}
+
+void SPH::Set_Pressure_Solver(Pressure_Solver solver){
+	Solver = solver;
+}
+
+Pressure_Solver SPH::Get_Pressure_Solver(){
+	return Solver;
+}
+
+void SPH::Set_Solver_Tolerance(Real tolerance){
+	Solver_Tolerance = tolerance;
+}
+
+void SPH::Set_Solver_Iterations(int min_iterations, int max_iterations){
+	Min_Solver_Iterations = min_iterations;
+	Max_Solver_Iterations = max(min_iterations, max_iterations);
+}
+
+int SPH::Get_Solver_Iterations(){
+	return Solver_Iterations;
+}
+
+long long SPH::Get_Total_Solver_Iterations(){
+	return Total_Solver_Iterations;
+}
+
+Real SPH::Get_Density_Error(){
+	return Density_Error;
+}
+
+void SPH::Set_Cell_Order(Curve_Type order){
+	Cell_Order = order;
+	Curve_Rank(Cell_Order, (int)Grid_Size.x, (int)Grid_Size.y, Cell_Rank);
+	Neighbor_List_Valid = false;
+}
+
+void SPH::Set_Reorder_Interval(int steps){
+	Reorder_Interval = steps;
+	Next_Reorder = Step_Count;
+}
+
+void SPH::Set_Neighbor_List(bool enable, Real skin){
+	Use_Neighbor_List = enable;
+	Skin = skin;
+	Neighbor_List_Valid = false;
+}
+
+void SPH::Set_Symmetric_Force(bool enable){
+	Use_Symmetric_Force = enable;
+}
+
+// threads for every phase of the step, 0 or less for all the OpenMP default
+void SPH::Set_Thread_Number(int threads){
+#ifdef _OPENMP
+	if(threads <= 0)
+		threads = omp_get_max_threads();
+#else
+	threads = 1;
+#endif
+	Number_Threads = threads;
+	delete[] Buffers;
+	Buffers = new Neighbor_Buffer[threads];
+	free(Block_Sum);
+	Block_Sum = (int *)malloc(sizeof(int) * (threads + 1));
+}
+
+int SPH::Get_Thread_Number(){
+	return Number_Threads;
+}
+
+void SPH::Set_SIMD_Level(SIMD_Level level){
+	Kernels = Get_SIMD_Kernels(level);
+}
+
+SIMD_Level SPH::Get_SIMD_Level(){
+	return Kernels.level;
+}
+
+void SPH::Set_Profile_Interval(int steps){
+	Profile_Interval = steps;
+}
+
+const Profiler& SPH::Get_Profiler(){
+	return Timing;
+}
+
+void SPH::Update_Kernel_Constants(){
+	Constants.Set(kernel, mass, Viscosity_Constant);
 }
 
 int SPH::Get_Particle_Number(){
 	return Number_Particles;
 }
 
-Vector2 SPH::Get_World_Size(){
+int SPH::Get_Capacity(){
+	return Max_Number_Paticles;
+}
+
+// current index of a particle in the arrays, it changes whenever the particles are sorted
+int SPH::Get_Particle_Index(Particle_Handle handle){
+	return Handle_Index[handle];
+}
+
+int SPH::Get_Step_Count(){
+	return Step_Count;
+}
+
+int SPH::Get_Neighbor_Builds(){
+	return Neighbor_Builds;
+}
+
+int SPH::Get_Neighbor_Steps(){
+	return Neighbor_Steps;
+}
+
+int SPH::Get_Neighbor_Count(){
+	return Neighbor_List_Valid ? Neighbor_Start[Number_Particles] : 0;
+}
+
+Vector2r SPH::Get_World_Size(){
 	return World_Size;
 }
 
+Real SPH::Get_Kernel(){
+	return kernel;
+}
+
+Real SPH::Get_Time_Delta(){
+	return Time_Delta;
+}
+
+double SPH::Get_Simulation_Time(){
+	return Simulation_Time;
+}
+
 Particle* SPH::Get_Paticles(){
-	return Particles;
+	// fill the struct view from the arrays
+	#pragma omp parallel for num_threads(Number_Threads)
+	for(int i = 0; i < Number_Particles; i++){
+		Particle *p = &Particle_View[i];
+		p->pos = Vector2r(Particles.pos_x[i], Particles.pos_y[i]);
+		p->vel = Vector2r(Particles.vel_x[i], Particles.vel_y[i]);
+		p->acc = Vector2r(Particles.acc_x[i], Particles.acc_y[i]);
+		p->dens = Particles.dens[i];
+		p->pres = Particles.pres[i];
+	}
+	return Particle_View;
+}
+
+Particle_Arrays* SPH::Get_Particle_Arrays(){
+	return &Particles;
 }
 
 Cell* SPH::Get_Cells(){
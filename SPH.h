@@ -1,58 +1,271 @@
 #ifndef __SPHSYSTEM_H__
 #define __SPHSYSTEM_H__
 
-#include "ObjLibrary/Vector2.h"
+#include <atomic>
+#include <vector>
 #include "DataStructure.h"
+#include "SpaceFillingCurve.h"
+#include "Kernel.h"
+#include "SIMDKernels.h"
+#include "Profiler.h"
+#include "DistanceField.h"
 
-#define PI 3.141592f
 #define INF 1E-12f
 
+class Surface_Lines;
+
+// how the pressure is found
+enum Pressure_Solver{
+	SOLVER_WCSPH,				// weakly compressible, pressure from the Tait equation
+	SOLVER_IISPH,				// implicit incompressible, pressure from an iterative solve
+	SOLVER_PCISPH				// predictive-corrective, pressure raised until the predicted density fits
+};
+
 class SPH{
 	private:
-		float kernel;					// kernel or h in kernel function
-		float mass;						// mass of particles
-		int Max_Number_Paticles;		// initial array for particles
+		Real kernel;					// kernel or h in kernel function
+		Real mass;						// mass of particles
+		int Max_Number_Paticles;		// capacity of the particle arrays, grows as particles are added
 		int Number_Particles;			// paticle number
 
-		Vector2 Grid_Size;				// grid size
-		Vector2 World_Size;				// screen size
-		float Cell_Size;				// cell size
+		Vector2r Grid_Size;				// grid size
+		Vector2r World_Size;			// screen size
+		Real Cell_Size;					// cell size
 		int Number_Cells;				// cell number
 
-		Vector2 Gravity;
-		float K;						// ideal pressure formulation k
-		float Stand_Density;			// ideal pressure formulation p0
-		float Time_Delta;
-		float Wall_Hit;
-		float Viscosity_Constant;
+		Vector2r Gravity;
+		Real K;							// ideal pressure formulation k
+		Real Stand_Density;				// ideal pressure formulation p0
+		Real Time_Delta;
+		bool Adaptive_Time;				// choose Time_Delta every step from the state
+		Real Min_Time_Delta;			// bounds of the adaptive time step
+		Real Max_Time_Delta;
+		Real CFL_Number;				// fraction of a kernel a sound wave may travel per step
+		double Simulation_Time;			// physical time since Init_Fluid
 
-		float CONSTANT1;
-		float CONSTANT2;
+		Pressure_Solver Solver;
+		Real Solver_Tolerance;			// allowed mean compression as a fraction of the rest density
+		int Min_Solver_Iterations;
+		int Max_Solver_Iterations;
+		int Solver_Iterations;			// iterations of the last step
+		long long Total_Solver_Iterations;
+		Real Density_Error;				// mean compression after the last solve
+		Solver_Arrays Solver_Data;
+		int *Pair_Start;				// pairs within the kernel in compressed rows, like the neighbor list
+		int *Pair_Index;
+		Real *Pair_Grad_x;				// gradient of the spiky kernel of every pair
+		Real *Pair_Grad_y;
+		int Pair_Capacity;
+		Real Wall_Hit;
+		Real Viscosity_Constant;
 
-		Particle *Particles;
+		Distance_Field Boundary;		// the walls, baked before the first step that needs them
+		bool Use_Boundary;				// walls add density and pressure, otherwise only the clamping holds the particles
+		bool Boundary_Valid;			// the field fits the kernel, the world and the rest density
+		int Boundary_Subdivide;			// field nodes per cell edge
+		Real *Boundary_Grad_x;			// gradient of the wall density at every particle, from the density pass
+		Real *Boundary_Grad_y;
+		std::vector<Obstacle> Obstacles;	// solids inside the box, part of the walls
+
+		Particle_Arrays Particles;		// particle data, one array per field
+		Particle_Arrays Sorted_Particles;	// scratch arrays for sorting particles by cell
+		Particle *Particle_View;		// particles as structs for Get_Paticles()
 		Cell *Cells;
+
+		Curve_Type Cell_Order;			// order of the cells in memory
+		int *Cell_Rank;					// position of cell y * Grid_Size.x + x in Cells
+		int Reorder_Interval;			// steps between particle reorders, 0 to disable
+		int Next_Reorder;				// step of the next reorder
+		unsigned int *Sort_Keys;		// scratch for Reorder_Particles
+		int *Sort_Index;
+
+		int Step_Count;					// steps since Init_Fluid
+
+		bool Use_Neighbor_List;			// reuse neighbor lists instead of searching the grid every step
+		Real Skin;						// extra radius of the neighbor list
+		bool Neighbor_List_Valid;
+		int *Neighbor_Start;			// compressed rows, Number_Particles + 1 entries
+		int *Neighbor_Index;
+		int Neighbor_Capacity;
+		Real *List_Pos_x;				// positions when the list was built
+		Real *List_Pos_y;
+		int Neighbor_Builds;			// number of list builds
+		int Neighbor_Steps;				// number of steps in neighbor list mode
+
+		SIMD_Kernels Kernels;			// density and force sums, scalar or vectorized
+		Kernel_Constants Constants;		// kernel size and the factors of the kernel functions
+
+		int Number_Threads;				// threads of every parallel phase
+		Neighbor_Buffer *Buffers;		// one per thread, neighbors of the current particle or cell
+		std::atomic<int> *Cell_Count;	// particles per cell while building the grid
+		int *Grid_Slot;					// place of every particle inside its cell
+		int *Grid_Index;				// particle to copy to every place of the sorted arrays
+		int *Handle_Index;				// current index of every particle handle
+		int *Block_Sum;					// per thread sums of the parallel prefix sum
+
+		Profiler Timing;				// time of every phase of the last steps
+		int Profile_Interval;			// steps between printing Timing, 0 to never print
+
+		void Init_Grid();
+		void Update_Kernel_Constants();
+		Real Compute_Time_Delta(bool compressible);
+		void Solve_IISPH();
+		void Solve_PCISPH();
+		void Build_Solver_Pairs(Real margin = 0.0f);
+		void Bake_Boundary();
+
+		// calls f(j, dx, dy, dis) for every particle j within the kernel of particle i,
+		// from the neighbor list or the 3x3 cells around i, dx and dy point from j to i
+		template<class F>
+		void For_Each_Neighbor(int i, F f){
+			Real px = Particles.pos_x[i];
+			Real py = Particles.pos_y[i];
+			if(Use_Neighbor_List){
+				for(int m = Neighbor_Start[i]; m < Neighbor_Start[i + 1]; m++){
+					int j = Neighbor_Index[m];
+					Real dx = px - Particles.pos_x[j];
+					Real dy = py - Particles.pos_y[j];
+					Real dis2 = dx * dx + dy * dy;
+					if((dis2 < Constants.kernel2)&&(dis2 > INF))
+						f(j, dx, dy, (Real)sqrt(dis2));
+				}
+				return;
+			}
+			Vector2r CellPos = Calculate_Cell_Position(Vector2r(px, py));
+			for(int a = -1; a <= 1; a++)
+				for(int b = -1; b <= 1; b++){
+					int hash = Calculate_Cell_Hash(CellPos + Vector2r(a, b));
+					if(hash == -1)
+						continue;
+					for(int j = Cells[hash].start; j < Cells[hash].end; j++){
+						Real dx = px - Particles.pos_x[j];
+						Real dy = py - Particles.pos_y[j];
+						Real dis2 = dx * dx + dy * dy;
+						if((dis2 < Constants.kernel2)&&(dis2 > INF))
+							f(j, dx, dy, (Real)sqrt(dis2));
+					}
+				}
+		}
+		// calls f(j, dx, dy, dis) for every particle j within radius of particle i, from the cells
+		// within reach; with a neighbor list the grid is as old as the list and every particle may
+		// have moved half the skin since, so the search reaches a skin further
+		template<class F>
+		void For_Each_Within(int i, Real radius, F f){
+			Real px = Particles.pos_x[i];
+			Real py = Particles.pos_y[i];
+			Real radius2 = radius * radius;
+			int reach = (int)ceil((radius + (Use_Neighbor_List ? Skin : 0.0f)) / Cell_Size);
+			Vector2r CellPos = Calculate_Cell_Position(Vector2r(px, py));
+			for(int a = -reach; a <= reach; a++)
+				for(int b = -reach; b <= reach; b++){
+					int hash = Calculate_Cell_Hash(CellPos + Vector2r(a, b));
+					if(hash == -1)
+						continue;
+					for(int j = Cells[hash].start; j < Cells[hash].end; j++){
+						Real dx = px - Particles.pos_x[j];
+						Real dy = py - Particles.pos_y[j];
+						Real dis2 = dx * dx + dy * dy;
+						if((dis2 < radius2)&&(dis2 > INF))
+							f(j, dx, dy, (Real)sqrt(dis2));
+					}
+				}
+		}
+		int Gather_Cells(int x, int y, bool all_fields, Neighbor_Buffer &b);
+		int Gather_List(int k, bool all_fields, Neighbor_Buffer &b);
+		int Search_Neighbors(int k, int *out);
+		void Set_Density(int k, Real dens);
+		void Set_Force(int k, Real ax, Real ay);
+
+		bool Use_Symmetric_Force;		// evaluate every pair once and apply it to both particles
+		Real *Force_Buffer;				// acceleration x and y per thread for the symmetric force
+		int Force_Buffer_Threads;
+
+		void Pair_Force(int a, int b, Real *acc_x, Real *acc_y);
+		void Computer_Force_Symmetric();
 	public:
 		SPH();
 		~SPH();
 		void Init_Fluid();									// initialize fluid
-		void Init_Particle(Vector2 pos, Vector2 vel);		// initialize particle system
-		Vector2 Calculate_Cell_Position(Vector2 pos);		// get cell position
-		int Calculate_Cell_Hash(Vector2 pos);				// get cell hash number
+		void Init_Block(Vector2r lower, Vector2r upper, Real spacing);	// fill a rectangle with particles
+		Particle_Handle Init_Particle(Vector2r pos, Vector2r vel);		// initialize particle system
+		void Reserve(int capacity);							// room for capacity particles
+		Vector2r Calculate_Cell_Position(Vector2r pos);		// get cell position
+		int Calculate_Cell_Hash(Vector2r pos);				// get cell hash number
 
 		//kernel function
-		float Poly6(float r2);		// for density
-		float Spiky(float r);		// for pressure
-		float Visco(float);			// for viscosity
+		Real Poly6(Real r2);		// for density
+		Real Spiky(Real r);			// for pressure
+		Real Visco(Real);			// for viscosity
 
 		void Hash_Grid();
+		void Reorder_Particles();							// sort particles along the cell curve
+		void Build_Neighbor_List();
+		bool Neighbor_List_Expired();
 		void Comupte_Density_SingPressure();
 		void Computer_Force();
 		void Update_Pos_Vel();
 		void Animation();
 
+		// the whole state in a binary file, false and a message if it fails, a failed load changes nothing
+		bool Save_Checkpoint(const char *file_name);
+		bool Load_Checkpoint(const char *file_name);
+
+		// the free surface as line segments where the volume spread on a grid of subdivide
+		// squares per cell edge is iso, see Surface.h, only reads the particles
+		void Extract_Surface(Surface_Lines &surface, int subdivide = 1, Real iso = 0.5f);
+
+		// parameters, the kernel and the world size should be set before adding particles
+		void Set_Kernel(Real h);
+		void Set_Mass(Real m);
+		void Set_World_Size(Vector2r size);			// rounded down to whole cells
+		void Set_Gravity(Vector2r g);
+		void Set_Stiffness(Real k);
+		void Set_Rest_Density(Real density);
+		void Set_Viscosity(Real viscosity);
+		void Set_Time_Delta(Real dt);
+		void Set_Wall_Hit(Real factor);
+		// walls from a baked distance field with subdivide nodes per cell edge, or only clamping
+		void Set_Boundary(bool enable, int subdivide = 4);
+		// o becomes part of the walls and Init_Block leaves it empty, only with the boundary
+		// enabled it holds the fluid, obstacles are not saved in checkpoints
+		void Add_Obstacle(const Obstacle &o);
+		int Get_Obstacle_Number();
+		bool Get_Boundary();
+		const Distance_Field& Get_Boundary_Field();		// baked by the next step after a change
+		void Set_Adaptive_Time_Step(bool enable, Real min_dt, Real max_dt);
+		void Set_CFL_Number(Real cfl);
+		void Set_Pressure_Solver(Pressure_Solver solver);
+		Pressure_Solver Get_Pressure_Solver();
+		void Set_Solver_Tolerance(Real tolerance);				// mean compression, 0.01 for 1%
+		void Set_Solver_Iterations(int min_iterations, int max_iterations);
+		int Get_Solver_Iterations();							// of the last step
+		long long Get_Total_Solver_Iterations();
+		Real Get_Density_Error();								// mean compression after the last solve
+
+		void Set_Cell_Order(Curve_Type order);
+		void Set_Reorder_Interval(int steps);
+		void Set_Neighbor_List(bool enable, Real skin);
+		void Set_Symmetric_Force(bool enable);
+		void Set_Thread_Number(int threads);		// 0 for the OpenMP default
+		int Get_Thread_Number();
+		void Set_SIMD_Level(SIMD_Level level);		// clamped to what the CPU supports
+		SIMD_Level Get_SIMD_Level();
+		void Set_Profile_Interval(int steps);		// print the phase times every steps, 0 to never
+		const Profiler& Get_Profiler();
+
 		int Get_Particle_Number();
-		Vector2 Get_World_Size();
-		Particle* Get_Paticles();
+		int Get_Capacity();
+		int Get_Particle_Index(Particle_Handle handle);
+		int Get_Step_Count();
+		int Get_Neighbor_Builds();
+		int Get_Neighbor_Steps();
+		int Get_Neighbor_Count();						// entries in the neighbor list
+		Vector2r Get_World_Size();
+		Real Get_Kernel();
+		Real Get_Time_Delta();
+		double Get_Simulation_Time();
+		Particle* Get_Paticles();						// particles copied into structs
+		Particle_Arrays* Get_Particle_Arrays();
 		Cell* Get_Cells();
 };
 
@@ -0,0 +1,80 @@
+//
+//  Snapshot.h
+//
+//  A copy of the particle positions at one step, for drawing
+//    while the simulation thread goes on.  The positions are
+//    stored as x, y pairs of floats, the layout glVertex2fv
+//    and vertex arrays expect.  Density or pressure can be
+//    copied along to color the particles by.
+//
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "AlignedMemory.h"
+#include "SPH.h"
+
+// value copied with the positions to color the particles by
+enum Snapshot_Value{
+	VALUE_NONE,
+	VALUE_DENSITY,
+	VALUE_PRESSURE,
+	VALUE_COUNT
+};
+
+class Particle_Snapshot
+{
+public:
+	float *pos;			// x and y of every particle
+	float *value;		// density or pressure of every particle, unless kind is VALUE_NONE
+	Snapshot_Value kind;
+	float low, high;	// range of value
+	int count;			// particles
+	int capacity;
+	int step;			// step the positions belong to
+
+	Particle_Snapshot(){
+		pos = value = NULL;
+		kind = VALUE_NONE;
+		low = high = 0.0f;
+		count = capacity = step = 0;
+	}
+
+	~Particle_Snapshot(){
+		Aligned_Free(pos);
+		Aligned_Free(value);
+	}
+
+	// copy the current positions of sph and the chosen value, only call it from the thread that steps sph
+	void Capture(SPH &sph, Snapshot_Value chosen = VALUE_NONE){
+		const Particle_Arrays *p = sph.Get_Particle_Arrays();
+		count = sph.Get_Particle_Number();
+		if(count > capacity){
+			capacity = sph.Get_Capacity();
+			Aligned_Grow(pos, 0, (size_t)capacity * 2);
+			Aligned_Grow(value, 0, (size_t)capacity);
+		}
+		for(int i = 0; i < count; i++){
+			pos[2 * i] = (float)p->pos_x[i];
+			pos[2 * i + 1] = (float)p->pos_y[i];
+		}
+		kind = chosen;
+		low = high = 0.0f;
+		if(kind != VALUE_NONE){
+			const Real *src = kind == VALUE_DENSITY ? p->dens : p->pres;
+			low = high = count > 0 ? (float)src[0] : 0.0f;
+			for(int i = 0; i < count; i++){
+				value[i] = (float)src[i];
+				low = value[i] < low ? value[i] : low;
+				high = value[i] > high ? value[i] : high;
+			}
+		}
+		step = sph.Get_Step_Count();
+	}
+
+private:
+	Particle_Snapshot(const Particle_Snapshot&);			// not copyable, it owns pos
+	Particle_Snapshot& operator=(const Particle_Snapshot&);
+};
+
+#endif
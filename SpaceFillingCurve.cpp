@@ -0,0 +1,125 @@
+//
+//  SpaceFillingCurve.cpp
+//
+
+#include "SpaceFillingCurve.h"
+#include <string.h>
+#include <stdlib.h>
+
+// spread the low 16 bits so there is a zero bit between each of them
+static unsigned int Part1By1(unsigned int v){
+	v &= 0x0000ffff;
+	v = (v | (v << 8)) & 0x00ff00ff;
+	v = (v | (v << 4)) & 0x0f0f0f0f;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+static unsigned int Compact1By1(unsigned int v){
+	v &= 0x55555555;
+	v = (v | (v >> 1)) & 0x33333333;
+	v = (v | (v >> 2)) & 0x0f0f0f0f;
+	v = (v | (v >> 4)) & 0x00ff00ff;
+	v = (v | (v >> 8)) & 0x0000ffff;
+	return v;
+}
+
+unsigned int Morton_Encode(unsigned int x, unsigned int y){
+	return Part1By1(x) | (Part1By1(y) << 1);
+}
+
+void Morton_Decode(unsigned int key, unsigned int &x, unsigned int &y){
+	x = Compact1By1(key);
+	y = Compact1By1(key >> 1);
+}
+
+unsigned int Hilbert_Encode(unsigned int n, unsigned int x, unsigned int y){
+	unsigned int d = 0;
+	for(unsigned int s = n / 2; s > 0; s /= 2){
+		unsigned int rx = (x & s) > 0;
+		unsigned int ry = (y & s) > 0;
+		d += s * s * ((3 * rx) ^ ry);
+		// rotate the quadrant
+		if(ry == 0){
+			if(rx == 1){
+				x = n - 1 - x;
+				y = n - 1 - y;
+			}
+			unsigned int t = x;
+			x = y;
+			y = t;
+		}
+	}
+	return d;
+}
+
+unsigned int Curve_Encode(Curve_Type type, int width, int height, int x, int y){
+	switch(type){
+	case CURVE_MORTON:
+		return Morton_Encode(x, y);
+	case CURVE_HILBERT:{
+		unsigned int n = 1;
+		while(n < (unsigned int)width || n < (unsigned int)height)
+			n *= 2;
+		return Hilbert_Encode(n, x, y);
+	}
+	default:
+		return y * width + x;
+	}
+}
+
+void Curve_Rank(Curve_Type type, int width, int height, int *rank){
+	int n = width * height;
+	unsigned int *keys = (unsigned int *)malloc(sizeof(unsigned int) * n * 2);
+	int *index = (int *)malloc(sizeof(int) * n * 2);
+	unsigned int max_key = 0;
+	for(int y = 0; y < height; y++)
+		for(int x = 0; x < width; x++){
+			int i = y * width + x;
+			keys[i] = Curve_Encode(type, width, height, x, y);
+			index[i] = i;
+			if(keys[i] > max_key)
+				max_key = keys[i];
+		}
+	// the curve covers a power of 2 square, so the keys have gaps, sorting closes them
+	Radix_Sort(keys, index, n, keys + n, index + n, max_key);
+	for(int r = 0; r < n; r++)
+		rank[index[r]] = r;
+	free(keys);
+	free(index);
+}
+
+void Radix_Sort(unsigned int *keys, int *index, int n,
+                unsigned int *temp_keys, int *temp_index, unsigned int max_key){
+	unsigned int *src_keys = keys;
+	int *src_index = index;
+	unsigned int *dst_keys = temp_keys;
+	int *dst_index = temp_index;
+	int count[256];
+
+	for(int shift = 0; shift < 32 && (max_key >> shift) != 0; shift += 8){
+		memset(count, 0, sizeof(count));
+		for(int i = 0; i < n; i++)
+			count[(src_keys[i] >> shift) & 0xff]++;
+		int sum = 0;
+		for(int d = 0; d < 256; d++){
+			int c = count[d];
+			count[d] = sum;
+			sum += c;
+		}
+		for(int i = 0; i < n; i++){
+			int d = count[(src_keys[i] >> shift) & 0xff]++;
+			dst_keys[d] = src_keys[i];
+			dst_index[d] = src_index[i];
+		}
+		unsigned int *tk = src_keys; src_keys = dst_keys; dst_keys = tk;
+		int *ti = src_index; src_index = dst_index; dst_index = ti;
+	}
+
+	// odd number of passes, the result is in the scratch arrays
+	if(src_keys != keys){
+		memcpy(keys, src_keys, sizeof(unsigned int) * n);
+		memcpy(index, src_index, sizeof(int) * n);
+	}
+}
@@ -0,0 +1,38 @@
+//
+//  SpaceFillingCurve.h
+//
+//  Morton (Z-order) and Hilbert curve keys and a radix sort,
+//    used to keep particles that are close in space close in
+//    memory.
+//
+
+#ifndef __SPACEFILLINGCURVE_H__
+#define __SPACEFILLINGCURVE_H__
+
+enum Curve_Type{
+	CURVE_ROW,			// row by row, y * width + x
+	CURVE_MORTON,		// Z-order
+	CURVE_HILBERT
+};
+
+// interleave the low 16 bits of x and y, x in the even bits
+unsigned int Morton_Encode(unsigned int x, unsigned int y);
+void Morton_Decode(unsigned int key, unsigned int &x, unsigned int &y);
+
+// distance along the Hilbert curve filling a n x n grid, n is a power of 2
+unsigned int Hilbert_Encode(unsigned int n, unsigned int x, unsigned int y);
+
+// key of cell (x, y) in a width x height grid along the curve
+unsigned int Curve_Encode(Curve_Type type, int width, int height, int x, int y);
+
+// rank of every cell of a width x height grid along the curve,
+// rank[y * width + x] is in [0, width * height)
+void Curve_Rank(Curve_Type type, int width, int height, int *rank);
+
+// LSD radix sort of keys with 8 bit digits, index is moved along with the keys,
+// the sort is stable and only sorts the digits that are used by max_key,
+// the result ends in keys/index, temp_keys/temp_index are scratch of size n
+void Radix_Sort(unsigned int *keys, int *index, int n,
+                unsigned int *temp_keys, int *temp_index, unsigned int max_key);
+
+#endif
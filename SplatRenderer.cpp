@@ -0,0 +1,275 @@
+//
+//  SplatRenderer.cpp
+//
+
+#include "SplatRenderer.h"
+#include "ObjLibrary/TextureBmp.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+Splat_Renderer::Splat_Renderer(){
+	Width = Height = 0;
+	Tiles_X = Tiles_Y = 0;
+	View_Low = View_High = Vector2r(0.0f, 0.0f);
+	Radius = 0.0f;
+	Color = SPLAT_DENSITY;
+	Color_Low = Color_High = 0.0f;
+	Threads = 0;
+	Image = NULL;
+	Row_Bytes = 0;
+	Drawn = 0;
+	Render_Seconds = 0.0;
+	Last_Low = Last_High = 0.0f;
+	Set_Size(512, 512);
+}
+
+Splat_Renderer::~Splat_Renderer(){
+	delete[] Image;
+}
+
+bool Splat_Renderer::Set_Size(int width, int height){
+	if((width <= 0)||(height <= 0)){
+		printf("An image needs a positive size, not %d x %d\n", width, height);
+		return false;
+	}
+	Width = width;
+	Height = height;
+	Tiles_X = (width + SPLAT_TILE - 1) / SPLAT_TILE;
+	Tiles_Y = (height + SPLAT_TILE - 1) / SPLAT_TILE;
+	// rows of whole 4 pixel groups, the layout TextureBmp keeps without alpha
+	Row_Bytes = ((width + 3) / 4) * 4 * 3;
+	delete[] Image;
+	Image = new unsigned char[(size_t)Row_Bytes * height];
+	memset(Image, 255, (size_t)Row_Bytes * height);
+	return true;
+}
+
+void Splat_Renderer::Set_View(Vector2r low, Vector2r high){
+	View_Low = low;
+	View_High = high;
+}
+
+void Splat_Renderer::Set_Radius(Real radius){
+	Radius = radius;
+}
+
+void Splat_Renderer::Set_Color(Splat_Color color, Real low, Real high){
+	Color = color;
+	Color_Low = low;
+	Color_High = high;
+}
+
+void Splat_Renderer::Set_Threads(int threads){
+	Threads = threads;
+}
+
+int Splat_Renderer::Get_Drawn(){
+	return Drawn;
+}
+
+double Splat_Renderer::Get_Render_Seconds(){
+	return Render_Seconds;
+}
+
+Real Splat_Renderer::Get_Low(){
+	return Last_Low;
+}
+
+Real Splat_Renderer::Get_High(){
+	return Last_High;
+}
+
+void Splat_Renderer::Render(SPH &sph){
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	const Particle_Arrays *p = sph.Get_Particle_Arrays();
+	int n = sph.Get_Particle_Number();
+	Vector2r low = View_Low, high = View_High;
+	if((low.x == high.x)&&(low.y == high.y)){
+		low = Vector2r(0.0f, 0.0f);
+		high = sph.Get_World_Size();
+	}
+	// pixels per world unit, y goes down the image
+	float scale_x = Width / (float)(high.x - low.x);
+	float scale_y = Height / (float)(high.y - low.y);
+	float radius = (float)(Radius > 0.0f ? Radius : 0.3f * sph.Get_Kernel()) * 0.5f * (scale_x + scale_y);
+	float reach = radius + 0.5f;			// the anti-aliased edge goes half a pixel further
+	int tiles = Tiles_X * Tiles_Y;
+
+	int threads = 1;
+#ifdef _OPENMP
+	threads = Threads > 0 ? Threads : omp_get_max_threads();
+#endif
+	Splat_X.resize(n);
+	Splat_Y.resize(n);
+	Splat_Value.resize(n);
+	Thread_Count.assign((size_t)threads * tiles, 0);
+	Tile_Start.resize(tiles + 1);
+	vector<float> thread_low(threads, 0.0f), thread_high(threads, 0.0f);
+	vector<int> thread_drawn(threads, 0);
+	int total = 0;
+	float value_low = (float)Color_Low, value_scale = 0.0f;
+
+	#pragma omp parallel num_threads(threads)
+	{
+		// every thread takes one block of particles, so the tile lists keep particle order
+#ifdef _OPENMP
+		int t = omp_get_thread_num();
+		int team = omp_get_num_threads();
+#else
+		int t = 0;
+		int team = 1;
+#endif
+		int begin = (int)((long long)n * t / team);
+		int end = (int)((long long)n * (t + 1) / team);
+		int *count = &Thread_Count[(size_t)t * tiles];
+		float smallest = 1e30f, largest = -1e30f;
+		int drawn = 0;
+		for(int i = begin; i < end; i++){
+			float x = (float)(p->pos_x[i] - low.x) * scale_x;
+			float y = (float)(high.y - p->pos_y[i]) * scale_y;
+			Splat_X[i] = x;
+			Splat_Y[i] = y;
+			if((x + reach < 0.0f)||(x - reach > Width)||(y + reach < 0.0f)||(y - reach > Height)){
+				Splat_X[i] = -1e30f;	// outside the view
+				continue;
+			}
+			float v = Color == SPLAT_DENSITY ? (float)p->dens[i] :
+			          sqrtf((float)(p->vel_x[i] * p->vel_x[i] + p->vel_y[i] * p->vel_y[i]));
+			Splat_Value[i] = v;
+			smallest = min(smallest, v);
+			largest = max(largest, v);
+			drawn++;
+			int tx0 = max((int)floorf((x - reach) / SPLAT_TILE), 0), tx1 = min((int)floorf((x + reach) / SPLAT_TILE), Tiles_X - 1);
+			int ty0 = max((int)floorf((y - reach) / SPLAT_TILE), 0), ty1 = min((int)floorf((y + reach) / SPLAT_TILE), Tiles_Y - 1);
+			for(int ty = ty0; ty <= ty1; ty++)
+				for(int tx = tx0; tx <= tx1; tx++)
+					count[ty * Tiles_X + tx]++;
+		}
+		thread_low[t] = smallest;
+		thread_high[t] = largest;
+		thread_drawn[t] = drawn;
+		#pragma omp barrier
+
+		// the counts become the places the threads write to, tile by tile and thread by thread
+		#pragma omp single
+		{
+			for(int tile = 0; tile < tiles; tile++){
+				Tile_Start[tile] = total;
+				for(int u = 0; u < team; u++){
+					int c = Thread_Count[(size_t)u * tiles + tile];
+					Thread_Count[(size_t)u * tiles + tile] = total;
+					total += c;
+				}
+			}
+			Tile_Start[tiles] = total;
+			Splats.resize(max(total, 1));
+			Drawn = 0;
+			float smallest_all = 1e30f, largest_all = -1e30f;
+			for(int u = 0; u < team; u++){
+				Drawn += thread_drawn[u];
+				smallest_all = min(smallest_all, thread_low[u]);
+				largest_all = max(largest_all, thread_high[u]);
+			}
+			if(Color_Low >= Color_High){
+				Last_Low = Drawn > 0 ? smallest_all : 0.0f;
+				Last_High = Drawn > 0 ? largest_all : 0.0f;
+			}
+			else{
+				Last_Low = Color_Low;
+				Last_High = Color_High;
+			}
+			value_low = (float)Last_Low;
+			value_scale = Last_High > Last_Low ? 1.0f / (float)(Last_High - Last_Low) : 0.0f;
+		}
+
+		for(int i = begin; i < end; i++){
+			float x = Splat_X[i], y = Splat_Y[i];
+			if(x == -1e30f)
+				continue;
+			int tx0 = max((int)floorf((x - reach) / SPLAT_TILE), 0), tx1 = min((int)floorf((x + reach) / SPLAT_TILE), Tiles_X - 1);
+			int ty0 = max((int)floorf((y - reach) / SPLAT_TILE), 0), ty1 = min((int)floorf((y + reach) / SPLAT_TILE), Tiles_Y - 1);
+			for(int ty = ty0; ty <= ty1; ty++)
+				for(int tx = tx0; tx <= tx1; tx++)
+					Splats[count[ty * Tiles_X + tx]++] = i;
+		}
+		#pragma omp barrier
+
+		#pragma omp for schedule(dynamic, 1)
+		for(int tile = 0; tile < tiles; tile++)
+			Fill_Tile(tile, radius, value_low, value_scale);
+	}
+	Render_Seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// the discs of one tile over a white background, each one blended over the ones before it
+void Splat_Renderer::Fill_Tile(int tile, float radius, float low, float scale){
+	int left = (tile % Tiles_X) * SPLAT_TILE;
+	int top = (tile / Tiles_X) * SPLAT_TILE;
+	int width = min(SPLAT_TILE, Width - left);
+	int height = min(SPLAT_TILE, Height - top);
+	if(Tile_Start[tile] == Tile_Start[tile + 1]){
+		// most of the air is empty tiles
+		for(int y = 0; y < height; y++)
+			memset(Image + (size_t)(top + y) * Row_Bytes + left * 3, 255, width * 3);
+		return;
+	}
+
+	float pixels[SPLAT_TILE][SPLAT_TILE][3];
+	for(int y = 0; y < height; y++)
+		for(int x = 0; x < width; x++)
+			pixels[y][x][0] = pixels[y][x][1] = pixels[y][x][2] = 1.0f;
+	float reach = radius + 0.5f;
+	float reach2 = reach * reach;
+	for(int k = Tile_Start[tile]; k < Tile_Start[tile + 1]; k++){
+		int i = Splats[k];
+		float cx = Splat_X[i] - left, cy = Splat_Y[i] - top;
+		// blue at the low end of the range, green in the middle, red at the high end
+		float v = min(max((Splat_Value[i] - low) * scale, 0.0f), 1.0f) * 2.0f - 1.0f;
+		float color[3] = {max(v, 0.0f), 1.0f - fabsf(v), max(-v, 0.0f)};
+		int x0 = max((int)floorf(cx - reach), 0), x1 = min((int)ceilf(cx + reach), width - 1);
+		int y0 = max((int)floorf(cy - reach), 0), y1 = min((int)ceilf(cy + reach), height - 1);
+		for(int y = y0; y <= y1; y++)
+			for(int x = x0; x <= x1; x++){
+				float dx = x + 0.5f - cx, dy = y + 0.5f - cy;
+				float d2 = dx * dx + dy * dy;
+				if(d2 >= reach2)
+					continue;
+				// coverage falls from 1 to 0 over the pixel across the edge
+				float a = min(reach - sqrtf(d2), 1.0f);
+				for(int c = 0; c < 3; c++)
+					pixels[y][x][c] += (color[c] - pixels[y][x][c]) * a;
+			}
+	}
+
+	for(int y = 0; y < height; y++){
+		unsigned char *row = Image + (size_t)(top + y) * Row_Bytes + left * 3;
+		for(int x = 0; x < width; x++)
+			for(int c = 0; c < 3; c++)
+				row[3 * x + c] = (unsigned char)(pixels[y][x][c] * 255.0f + 0.5f);
+	}
+}
+
+bool Splat_Renderer::Save(const char *file_name){
+	// TextureBmp::save does not report errors, so try the file first
+	FILE *file = fopen(file_name, "wb");
+	if(file == NULL){
+		printf("Can not write %s\n", file_name);
+		return false;
+	}
+	fclose(file);
+	// the TextureBmp takes the array and deletes it
+	size_t bytes = (size_t)Row_Bytes * Height;
+	unsigned char *copy = new unsigned char[bytes];
+	memcpy(copy, Image, bytes);
+	TextureBmp image(Width, Height, false, (unsigned int)bytes, copy);
+	image.save(file_name);
+	return true;
+}
@@ -0,0 +1,83 @@
+//
+//  SplatRenderer.h
+//
+//  Draws the particles into an image on the CPU, for preview
+//    images on machines with no OpenGL.  Every particle is an
+//    anti-aliased disc colored by its density or its speed.
+//    The image is cut into square tiles.  The particles in the
+//    view are sorted into the tiles their discs touch, then the
+//    threads fill whole tiles, so no two threads write the same
+//    pixel and no locks are needed.  The sort keeps particle
+//    order inside every tile, so the image does not depend on
+//    the number of threads.
+//
+//  Save writes the image with TextureBmp::save of the
+//    ObjLibrary.
+//
+
+#ifndef __SPLATRENDERER_H__
+#define __SPLATRENDERER_H__
+
+#include <vector>
+#include "SPH.h"
+
+#define SPLAT_TILE 32				// tile edge in pixels
+
+enum Splat_Color{
+	SPLAT_DENSITY,
+	SPLAT_VELOCITY					// by speed
+};
+
+class Splat_Renderer
+{
+public:
+	Splat_Renderer();
+	~Splat_Renderer();
+
+	// image size in pixels, false and a message if it is not positive
+	bool Set_Size(int width, int height);
+	// part of the world shown, the whole world if low and high are equal
+	void Set_View(Vector2r low, Vector2r high);
+	// disc radius in world units, 0.3 kernel sizes if 0, half the default particle spacing
+	void Set_Radius(Real radius);
+	// values mapped from blue to red, the range of every frame if low and high are equal
+	void Set_Color(Splat_Color color, Real low, Real high);
+	void Set_Threads(int threads);				// 0 for the OpenMP default
+
+	// draw the particles of sph into the image
+	void Render(SPH &sph);
+	// write the image as a 24 bit bmp, false and a message if it fails
+	bool Save(const char *file_name);
+
+	int Get_Drawn();							// particles in the view in the last image
+	double Get_Render_Seconds();				// of the last Render
+	Real Get_Low();								// range of the colors in the last image
+	Real Get_High();
+
+private:
+	int Width, Height;
+	int Tiles_X, Tiles_Y;
+	Vector2r View_Low, View_High;				// equal for the whole world
+	Real Radius;
+	Splat_Color Color;
+	Real Color_Low, Color_High;
+	int Threads;
+
+	unsigned char *Image;						// RGB rows from the top, padded like TextureBmp
+	int Row_Bytes;
+	std::vector<float> Splat_X, Splat_Y;		// pixel coordinates of the particles in the view
+	std::vector<float> Splat_Value;
+	std::vector<int> Splats;					// indices into Splat_X, grouped by tile
+	std::vector<int> Tile_Start;				// range of every tile in Splats, Tiles + 1 entries
+	std::vector<int> Thread_Count;				// per thread and tile, for the stable sort
+	int Drawn;
+	double Render_Seconds;
+	Real Last_Low, Last_High;
+
+	void Fill_Tile(int tile, float radius, float low, float scale);
+
+	Splat_Renderer(const Splat_Renderer&);
+	Splat_Renderer& operator=(const Splat_Renderer&);
+};
+
+#endif
@@ -0,0 +1,252 @@
+//
+//  Surface.cpp
+//
+//  SPH::Extract_Surface and the OBJ output of Surface_Lines.
+//    The particles are sorted into bands of cell rows by their
+//    current positions, so the grid of the last step is not
+//    needed.  A particle only reaches the corners within one
+//    kernel of it, so bands two apart never add to the same
+//    corner, and the even bands and then the odd bands add
+//    their particles on all threads without locks.  Every row
+//    of squares is then a tile of the marching squares, first
+//    counted, then filled at its place in the output.
+//
+
+#include "SPH.h"
+#include "Surface.h"
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+#define SURFACE_BAND 4		// cell rows per band, wider than two kernels
+
+// segments of the squares of marching squares as pairs of edges, -1 ends the list.
+// Corners 0 to 3 are bottom left, bottom right, top right and top left, bit k of the case
+// is set if corner k is inside.  Edges 0 to 3 are bottom, right, top and left.  The saddles
+// 5 and 10 are for a center outside, with the center inside they swap.
+static const int Square_Segments[16][5] = {
+	{-1},
+	{3, 0, -1},
+	{0, 1, -1},
+	{3, 1, -1},
+	{1, 2, -1},
+	{3, 0, 1, 2, -1},
+	{0, 2, -1},
+	{3, 2, -1},
+	{2, 3, -1},
+	{0, 2, -1},
+	{0, 1, 2, 3, -1},
+	{1, 2, -1},
+	{1, 3, -1},
+	{0, 1, -1},
+	{3, 0, -1},
+	{-1}
+};
+
+// marching squares case of the square with bottom left corner (i, j)
+static inline int Square_Case(const float *field, int nx, int i, int j, float iso){
+	const float *row = field + (size_t)j * nx + i;
+	float v0 = row[0], v1 = row[1], v2 = row[nx + 1], v3 = row[nx];
+	int c = (v0 >= iso) | ((v1 >= iso) << 1) | ((v2 >= iso) << 2) | ((v3 >= iso) << 3);
+	if(((c == 5)||(c == 10))&&((v0 + v1 + v2 + v3) * 0.25f >= iso))
+		c ^= 15;
+	return c;
+}
+
+void SPH::Extract_Surface(Surface_Lines &s, int subdivide, Real iso){
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	int sub = max(subdivide, 1);
+	int nx = (int)Grid_Size.x * sub + 1;
+	int ny = (int)Grid_Size.y * sub + 1;
+	Real d = Cell_Size / sub;
+	int bands = ((int)Grid_Size.y + SURFACE_BAND - 1) / SURFACE_BAND;
+	Real band_height = Cell_Size * SURFACE_BAND;
+	int horizontal = (nx - 1) * ny;				// edges along x come first in edge_vertex
+	int n = Number_Particles;
+	int threads = Number_Threads;
+	float level = (float)iso;
+
+	s.field.assign((size_t)nx * ny, 0.0f);
+	s.edge_vertex.resize((size_t)horizontal + (size_t)nx * (ny - 1));
+	s.order.resize(n);
+	s.band_start.resize(bands + 1);
+	s.thread_count.assign((size_t)threads * bands, 0);
+	s.row_start.resize(ny + 1);
+	float *field = s.field.data();
+
+	#pragma omp parallel num_threads(threads)
+	{
+#ifdef _OPENMP
+		int t = omp_get_thread_num();
+		int team = omp_get_num_threads();
+#else
+		int t = 0;
+		int team = 1;
+#endif
+		// counting sort into bands, every thread a block of particles so the order is the same for any team
+		int begin = (int)((long long)n * t / team);
+		int end = (int)((long long)n * (t + 1) / team);
+		int *count = &s.thread_count[(size_t)t * bands];
+		for(int i = begin; i < end; i++)
+			count[min(max((int)(Particles.pos_y[i] / band_height), 0), bands - 1)]++;
+		#pragma omp barrier
+		#pragma omp single
+		{
+			int sum = 0;
+			for(int b = 0; b < bands; b++){
+				s.band_start[b] = sum;
+				for(int u = 0; u < team; u++){
+					int c = s.thread_count[(size_t)u * bands + b];
+					s.thread_count[(size_t)u * bands + b] = sum;
+					sum += c;
+				}
+			}
+			s.band_start[bands] = sum;
+		}
+		for(int i = begin; i < end; i++)
+			s.order[count[min(max((int)(Particles.pos_y[i] / band_height), 0), bands - 1)]++] = i;
+		#pragma omp barrier
+
+		// the volume of every particle spread over the corners within its kernel
+		for(int phase = 0; phase < 2; phase++){
+			#pragma omp for schedule(dynamic, 1)
+			for(int b = phase; b < bands; b += 2)
+				for(int k = s.band_start[b]; k < s.band_start[b + 1]; k++){
+					int p = s.order[k];
+					Real x = Particles.pos_x[p];
+					Real y = Particles.pos_y[p];
+					Real volume = mass / (Particles.dens[p] > INF ? Particles.dens[p] : Stand_Density);
+					// corners strictly inside the kernel, the positions are in the world so x + kernel > 0
+					Real left = (x - kernel) / d, bottom = (y - kernel) / d;
+					int i0 = left > 0.0f ? (int)left + 1 : 0, i1 = min((int)((x + kernel) / d), nx - 1);
+					int j0 = bottom > 0.0f ? (int)bottom + 1 : 0, j1 = min((int)((y + kernel) / d), ny - 1);
+					for(int j = j0; j <= j1; j++){
+						Real dy = j * d - y;
+						float *row = field + (size_t)j * nx;
+						for(int i = i0; i <= i1; i++){
+							Real dx = i * d - x;
+							Real r2 = dx * dx + dy * dy;
+							if(r2 < Constants.kernel2)
+								row[i] += (float)(volume * Kernel_Poly6(Constants, r2));
+						}
+					}
+				}
+		}
+
+		// a vertex on every edge that crosses iso, numbered row by row
+		#pragma omp for
+		for(int j = 0; j < ny; j++){
+			const float *row = field + (size_t)j * nx;
+			int crossings = 0;
+			for(int i = 0; i < nx - 1; i++)
+				crossings += (row[i] >= level) != (row[i + 1] >= level);
+			if(j < ny - 1)
+				for(int i = 0; i < nx; i++)
+					crossings += (row[i] >= level) != (row[i + nx] >= level);
+			s.row_start[j] = crossings;
+		}
+		#pragma omp single
+		{
+			int sum = 0;
+			for(int j = 0; j < ny; j++){
+				int c = s.row_start[j];
+				s.row_start[j] = sum;
+				sum += c;
+			}
+			s.row_start[ny] = sum;
+			s.vertices.resize(sum);
+		}
+		#pragma omp for
+		for(int j = 0; j < ny; j++){
+			const float *row = field + (size_t)j * nx;
+			int id = s.row_start[j];
+			for(int i = 0; i < nx - 1; i++){
+				int &v = s.edge_vertex[(size_t)j * (nx - 1) + i];
+				v = -1;
+				if((row[i] >= level) != (row[i + 1] >= level)){
+					Real f = (level - row[i]) / (row[i + 1] - row[i]);
+					s.vertices[id] = Vector2r((i + f) * d, j * d);
+					v = id++;
+				}
+			}
+			if(j < ny - 1)
+				for(int i = 0; i < nx; i++){
+					int &v = s.edge_vertex[(size_t)horizontal + (size_t)j * nx + i];
+					v = -1;
+					if((row[i] >= level) != (row[i + nx] >= level)){
+						Real f = (level - row[i]) / (row[i + nx] - row[i]);
+						s.vertices[id] = Vector2r(i * d, (j + f) * d);
+						v = id++;
+					}
+				}
+		}
+
+		// segments, one tile per row of squares
+		#pragma omp for
+		for(int j = 0; j < ny - 1; j++){
+			int segments = 0;
+			for(int i = 0; i < nx - 1; i++){
+				const int *e = Square_Segments[Square_Case(field, nx, i, j, level)];
+				for(; *e >= 0; e += 2)
+					segments++;
+			}
+			s.row_start[j] = segments;
+		}
+		#pragma omp single
+		{
+			int sum = 0;
+			for(int j = 0; j < ny - 1; j++){
+				int c = s.row_start[j];
+				s.row_start[j] = sum;
+				sum += c;
+			}
+			s.segments.resize(2 * (size_t)sum);
+		}
+		#pragma omp for
+		for(int j = 0; j < ny - 1; j++){
+			int *out = s.segments.data() + 2 * (size_t)s.row_start[j];
+			for(int i = 0; i < nx - 1; i++){
+				const int *e = Square_Segments[Square_Case(field, nx, i, j, level)];
+				if(*e < 0)
+					continue;
+				// the vertices on the bottom, right, top and left edge of the square
+				int edges[4] = {
+					s.edge_vertex[(size_t)j * (nx - 1) + i],
+					s.edge_vertex[(size_t)horizontal + (size_t)j * nx + i + 1],
+					s.edge_vertex[(size_t)(j + 1) * (nx - 1) + i],
+					s.edge_vertex[(size_t)horizontal + (size_t)j * nx + i]
+				};
+				for(; *e >= 0; e += 2){
+					*out++ = edges[e[0]];
+					*out++ = edges[e[1]];
+				}
+			}
+		}
+	}
+	s.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+bool Surface_Lines::Save_OBJ(const char *file_name) const{
+	FILE *file = fopen(file_name, "w");
+	if(file == NULL){
+		printf("Can not write %s\n", file_name);
+		return false;
+	}
+	fprintf(file, "# free surface, %d vertices, %d segments\n", (int)vertices.size(), Get_Segment_Number());
+	for(size_t v = 0; v < vertices.size(); v++)
+		fprintf(file, "v %g %g 0\n", (double)vertices[v].x, (double)vertices[v].y);
+	for(size_t k = 0; k + 1 < segments.size(); k += 2)
+		fprintf(file, "l %d %d\n", segments[k] + 1, segments[k + 1] + 1);
+	bool ok = !ferror(file);
+	if(fclose(file) != 0)
+		ok = false;
+	if(!ok)
+		printf("Can not write %s\n", file_name);
+	return ok;
+}
@@ -0,0 +1,50 @@
+//
+//  Surface.h
+//
+//  The free surface of the fluid as line segments, found by
+//    SPH::Extract_Surface.  The particles spread their volume
+//    onto the corners of a grid with the cells of the solver
+//    cut into subdivide x subdivide squares, which gives about
+//    1 inside the fluid and 0 outside.  Marching squares then
+//    follows the line where it is iso.
+//
+//  A vertex lies on a grid edge and is shared by the segments
+//    of the two squares on either side, so the segments join
+//    into closed lines, or lines that end at the walls where
+//    the fluid touches them.
+//
+
+#ifndef __SURFACE_H__
+#define __SURFACE_H__
+
+#include <vector>
+#include "DataStructure.h"
+
+class Surface_Lines
+{
+public:
+	std::vector<Vector2r> vertices;
+	std::vector<int> segments;			// two vertex indices per segment
+	double seconds;						// time of the last extraction
+
+	// scratch of Extract_Surface, kept so the next extraction needs no allocation
+	std::vector<float> field;			// value at every grid corner, row by row
+	std::vector<int> edge_vertex;		// vertex of every grid edge, -1 for none
+	std::vector<int> order;				// particles sorted into bands of cell rows
+	std::vector<int> band_start;
+	std::vector<int> thread_count;
+	std::vector<int> row_start;			// first vertex or segment of every row
+
+	Surface_Lines(){
+		seconds = 0.0;
+	}
+
+	int Get_Segment_Number() const{
+		return (int)segments.size() / 2;
+	}
+
+	// the lines as an OBJ file of v and l elements, false and a message if it can not be written
+	bool Save_OBJ(const char *file_name) const;
+};
+
+#endif
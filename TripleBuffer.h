@@ -0,0 +1,57 @@
+//
+//  TripleBuffer.h
+//
+//  Hands the latest value from one writer thread to one reader
+//    thread without locks.  The writer fills the back buffer
+//    and publishes it, the reader takes the newest published
+//    buffer as its front buffer.  The third buffer sits in the
+//    middle, so neither side ever waits for the other, and a
+//    buffer is never written while it is read.  Values the
+//    reader did not pick up in time are dropped.
+//
+
+#ifndef __TRIPLEBUFFER_H__
+#define __TRIPLEBUFFER_H__
+
+#include <atomic>
+
+template<class T>
+class Triple_Buffer
+{
+private:
+	static const int FRESH = 4;		// set in Middle when it holds a buffer the reader has not taken
+
+	T Buffers[3];
+	std::atomic<int> Middle;		// index of the middle buffer, with the FRESH bit
+	int Back;						// only used by the writer
+	int Front;						// only used by the reader
+
+public:
+	Triple_Buffer() : Middle(1), Back(0), Front(2)
+	{}
+
+	// the buffer the writer may fill
+	T& Get_Back(){
+		return Buffers[Back];
+	}
+
+	// make the back buffer the newest value, the writer gets the old middle buffer back
+	void Publish(){
+		Back = Middle.exchange(Back | FRESH, std::memory_order_acq_rel) & 3;
+	}
+
+	// take the newest published buffer as the front buffer, false if nothing new was published
+	bool Update(){
+		if((Middle.load(std::memory_order_relaxed) & FRESH) == 0)
+			return false;
+		Front = Middle.exchange(Front, std::memory_order_acq_rel) & 3;
+		return true;
+	}
+
+	// the buffer the reader may read, the same until the next successful Update
+	const T& Get_Front() const{
+		return Buffers[Front];
+	}
+};
+
+#endif
@@ -0,0 +1,189 @@
+//
+//  Vector2f.h
+//
+//  A single precision version of Vector2 for the simulation.
+//    It has the same operators as Vector2 but stores floats,
+//    so it is half the size and needs no conversion when used
+//    with the float constants in SPH.  It has no user defined
+//    copy constructor or destructor, so it is trivially
+//    copyable and can be moved around with memcpy.
+//
+
+#ifndef __VECTOR2F_H__
+#define __VECTOR2F_H__
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <type_traits>
+#include "ObjLibrary/Vector2.h"
+
+class alignas(8) Vector2f
+{
+public:
+	float x;
+	float y;
+
+public:
+	Vector2f () : x(0.0f), y(0.0f)
+	{}
+
+	Vector2f (float X, float Y) : x(X), y(Y)
+	{}
+
+	// conversion from and to the double precision Vector2
+	explicit Vector2f (const Vector2& original) : x((float)original.x), y((float)original.y)
+	{}
+
+	Vector2 toVector2 () const
+	{
+		return Vector2(x, y);
+	}
+
+//
+//  Operators
+//
+
+	bool operator== (const Vector2f& other) const
+	{
+		return x == other.x && y == other.y;
+	}
+
+	bool operator!= (const Vector2f& other) const
+	{
+		return !(*this == other);
+	}
+
+	Vector2f operator- () const
+	{
+		return Vector2f(-x, -y);
+	}
+
+	Vector2f operator+ (const Vector2f& right) const
+	{
+		return Vector2f(x + right.x, y + right.y);
+	}
+
+	Vector2f operator- (const Vector2f& right) const
+	{
+		return Vector2f(x - right.x, y - right.y);
+	}
+
+	Vector2f operator* (float factor) const
+	{
+		return Vector2f(x * factor, y * factor);
+	}
+
+	Vector2f operator/ (float divisor) const
+	{
+		assert(divisor != 0.0f);
+		return Vector2f(x / divisor, y / divisor);
+	}
+
+	Vector2f& operator+= (const Vector2f& right)
+	{
+		x += right.x;
+		y += right.y;
+		return *this;
+	}
+
+	Vector2f& operator-= (const Vector2f& right)
+	{
+		x -= right.x;
+		y -= right.y;
+		return *this;
+	}
+
+	Vector2f& operator*= (float factor)
+	{
+		x *= factor;
+		y *= factor;
+		return *this;
+	}
+
+	Vector2f& operator/= (float divisor)
+	{
+		assert(divisor != 0.0f);
+		x /= divisor;
+		y /= divisor;
+		return *this;
+	}
+
+//
+//  Queries
+//
+
+	bool isZero () const
+	{
+		return x == 0.0f && y == 0.0f;
+	}
+
+	float getNorm () const
+	{
+		return sqrtf(x * x + y * y);
+	}
+
+	float getNormSquared () const
+	{
+		return x * x + y * y;
+	}
+
+	float dotProduct (const Vector2f& other) const
+	{
+		return x * other.x + y * other.y;
+	}
+
+	float getDistance (const Vector2f& other) const
+	{
+		return (*this - other).getNorm();
+	}
+
+	float getDistanceSquared (const Vector2f& other) const
+	{
+		return (*this - other).getNormSquared();
+	}
+
+	Vector2f getNormalized () const
+	{
+		assert(!isZero());
+		return *this / getNorm();
+	}
+
+//
+//  Modifiers
+//
+
+	void set (float X, float Y)
+	{
+		x = X;
+		y = Y;
+	}
+
+	void setZero ()
+	{
+		x = 0.0f;
+		y = 0.0f;
+	}
+
+	void normalize ()
+	{
+		assert(!isZero());
+		*this /= getNorm();
+	}
+};
+
+static_assert(sizeof(Vector2f) == 8, "Vector2f must be two packed floats");
+static_assert(std::is_trivially_copyable<Vector2f>::value, "Vector2f must be trivially copyable");
+
+inline Vector2f operator* (float scalar, const Vector2f& vector)
+{
+	return vector * scalar;
+}
+
+inline std::ostream& operator<< (std::ostream& r_os, const Vector2f& vector)
+{
+	r_os << "(" << vector.x << ", " << vector.y << ")";
+	return r_os;
+}
+
+#endif